@@ -0,0 +1,868 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <unistd.h>
+
+#include "bench.h"
+#include "dungeon.h"
+#include "path.h"
+#include "pc.h"
+#include "event.h"
+#include "utils.h"
+#include "pack.h"
+#include "rle.h"
+#include "descriptions.h"
+
+#define BENCH_PATH_ITERATIONS 2000
+#define BENCH_EVENTS          2000000
+#define BENCH_LEVELS          100
+#define BENCH_HARDNESS        50
+#define BENCH_ENCODING        200
+#define BENCH_DECODE          (64 << 20)
+#define BENCH_DESCRIPTIONS    200
+#define BENCH_LOS_QUERIES     1000000
+#define BENCH_LOS_OBSERVES    50000
+
+/* Times each path engine on each saved dungeon named on the command *
+ * line (both maps, from the PC position stored in the file) and     *
+ * verifies that every engine produces the same maps as the heap.    */
+int bench_path(int argc, char *argv[])
+{
+  static void (*walk[num_path_engines])(dungeon *d) = {
+    dijkstra_heap,
+    dijkstra_bucket
+  };
+  static void (*tunnel[num_path_engines])(dungeon *d) = {
+    dijkstra_tunnel_heap,
+    dijkstra_tunnel_bucket
+  };
+  grid<distance_t> distance, tunnel_distance;
+  double start, elapsed[num_path_engines], total[num_path_engines];
+  int i, e, n, mismatch;
+
+  if (!argc) {
+    fprintf(stderr, "bench path: expected one or more .rlg327 files\n");
+    return 1;
+  }
+
+  memset(total, 0, sizeof (total));
+
+  printf("%-32s", "dungeon");
+  for (e = 0; e < num_path_engines; e++) {
+    printf("%10s us", path_engine_name[e]);
+  }
+  printf("%10s\n", "speedup");
+
+  for (mismatch = i = 0; i < argc; i++) {
+    dungeon d;
+
+    init_dungeon(&d);
+    d.PC = new pc;
+    d.PC->position[dim_x] = d.PC->position[dim_y] = 0;
+    read_dungeon(&d, argv[i]);
+
+    for (e = 0; e < num_path_engines; e++) {
+      start = wall_time();
+      for (n = 0; n < BENCH_PATH_ITERATIONS; n++) {
+        walk[e](&d);
+        tunnel[e](&d);
+      }
+      elapsed[e] = (wall_time() - start) * 1000000.0 / BENCH_PATH_ITERATIONS;
+      total[e] += elapsed[e];
+
+      if (e == path_engine_heap) {
+        distance = d.pc_distance;
+        tunnel_distance = d.pc_tunnel;
+      } else if (memcmp(distance.data(), d.pc_distance.data(),
+                        distance.size() * sizeof (distance_t)) ||
+                 memcmp(tunnel_distance.data(), d.pc_tunnel.data(),
+                        tunnel_distance.size() * sizeof (distance_t))) {
+        fprintf(stderr, "%s: %s engine disagrees with heap engine\n",
+                argv[i], path_engine_name[e]);
+        mismatch = 1;
+      }
+    }
+
+    printf("%-32s", argv[i]);
+    for (e = 0; e < num_path_engines; e++) {
+      printf("%13.2f", elapsed[e]);
+    }
+    printf("%9.2fx\n", elapsed[path_engine_heap] /
+                       elapsed[path_engine_bucket]);
+
+    delete d.PC;
+    d.PC = NULL;
+    delete_dungeon(&d);
+  }
+
+  printf("%-32s", "mean");
+  for (e = 0; e < num_path_engines; e++) {
+    printf("%13.2f", total[e] / argc);
+  }
+  printf("%9.2fx\n", total[path_engine_heap] / total[path_engine_bucket]);
+
+  return mismatch;
+}
+
+/* Times each event queue engine on the loop at the heart of do_moves(): *
+ * pop the next event, reschedule it by its character's speed, push it   *
+ * back.  As in the game, the PC's event is freed and a new one made     *
+ * (with sequence 0) on each of its turns.  Runs with a PC plus each     *
+ * monster count on the command line (default 15, 500 and 10000), and    *
+ * verifies that every engine pops the same events in the same order.    */
+int bench_events(int argc, char *argv[])
+{
+  static const char *default_count[] = { "15", "500", "10000" };
+  uint32_t i, n, count;
+  uint64_t order[num_event_engines];
+  double start, rate[num_event_engines];
+  int e, mismatch;
+  event *ev;
+  rng r;
+
+  if (!argc) {
+    argc = sizeof (default_count) / sizeof (default_count[0]);
+    argv = (char **) default_count;
+  }
+
+  printf("%-10s", "monsters");
+  for (e = 0; e < num_event_engines; e++) {
+    printf("%12s ev/s (vs fib)", event_engine_name[e]);
+  }
+  printf("\n");
+
+  for (mismatch = i = 0; i < (uint32_t) argc; i++) {
+    if (sscanf(argv[i], "%u", &count) != 1) {
+      fprintf(stderr, "bench events: %s is not a monster count\n", argv[i]);
+      return 1;
+    }
+
+    std::vector<character> mob(count + 1);
+
+    r.seed(count);
+    mob[0].speed = PC_SPEED;
+    for (n = 1; n <= count; n++) {
+      mob[n].speed = r.range(NPC_MIN_SPEED, NPC_MAX_SPEED);
+    }
+
+    for (e = 0; e < num_event_engines; e++) {
+      dungeon d;
+
+      eventq_init(&d.events, (event_engine_t) e);
+      for (n = 1; n <= count; n++) {
+        eventq_insert(&d.events,
+                      new_event(&d, event_character_turn, &mob[n], 0));
+      }
+      ev = new_event(&d, event_character_turn, &mob[0], 0);
+      ev->sequence = 0;
+      eventq_insert(&d.events, ev);
+
+      order[e] = 0;
+      start = wall_time();
+      for (n = 0; n < BENCH_EVENTS; n++) {
+        ev = eventq_remove_min(&d.events);
+        d.time = ev->time;
+        order[e] = order[e] * 31 + (ev->c - &mob[0]);
+        if (ev->c == &mob[0]) {
+          eventq_free(&d.events, ev);
+          ev = new_event(&d, event_character_turn, &mob[0],
+                         1000 / mob[0].speed);
+          ev->sequence = 0;
+        } else {
+          update_event(&d, ev, 1000 / ev->c->speed);
+        }
+        eventq_insert(&d.events, ev);
+      }
+      rate[e] = BENCH_EVENTS / (wall_time() - start);
+
+      /* The characters aren't the queue's to delete. */
+      eventq_delete(&d.events);
+
+      if (order[e] != order[event_engine_fibonacci]) {
+        fprintf(stderr, "%u monsters: %s engine disagrees with fibonacci "
+                "engine\n", count, event_engine_name[e]);
+        mismatch = 1;
+      }
+    }
+
+    printf("%-10u", count);
+    for (e = 0; e < num_event_engines; e++) {
+      printf("%17.0f %8.2fx", rate[e], rate[e] / rate[event_engine_fibonacci]);
+    }
+    printf("\n");
+  }
+
+  return mismatch;
+}
+
+/* Parses arg, a WxH dungeon size, for the named bench.  Returns non- *
+ * zero, having said why, if it isn't one.                            */
+static int bench_parse_size(const char *name, const char *arg,
+                            uint16_t *w, uint16_t *h)
+{
+  if (sscanf(arg, "%hux%hu", w, h) != 2 ||
+      *w < DUNGEON_X || *w > MAX_DUNGEON_X ||
+      *h < DUNGEON_Y || *h > MAX_DUNGEON_Y) {
+    fprintf(stderr, "bench %s: %s is not a dungeon size\n", name, arg);
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Times gen_dungeon() with each corridor engine at each size on the    *
+ * command line (default 80x21 and 160x42), generating the same seeds  *
+ * with each.  The engines may pick different corridors of equal cost, *
+ * so the dungeons aren't compared; build with -DVERIFY_CORRIDOR_ROUTE *
+ * to check every A* corridor's cost against Dijkstra's.                */
+int bench_corridors(int argc, char *argv[])
+{
+  static const char *default_size[] = { "80x21", "160x42" };
+  uint16_t width, height;
+  double start, rate[num_corridor_engines];
+  uint32_t n;
+  int i, e;
+
+  if (!argc) {
+    argc = sizeof (default_size) / sizeof (default_size[0]);
+    argv = (char **) default_size;
+  }
+
+  printf("%-10s", "size");
+  for (e = 0; e < num_corridor_engines; e++) {
+    printf("%10s levels/s", corridor_engine_name[e]);
+  }
+  printf("%10s\n", "speedup");
+
+  for (i = 0; i < argc; i++) {
+    if (bench_parse_size("corridors", argv[i], &width, &height)) {
+      return 1;
+    }
+
+    for (e = 0; e < num_corridor_engines; e++) {
+      dungeon d;
+
+      d.width = width;
+      d.height = height;
+      d.corridor_engine = (corridor_engine_t) e;
+      init_dungeon(&d);
+
+      start = wall_time();
+      for (n = 0; n < BENCH_LEVELS; n++) {
+        d.rand.seed(n);
+        gen_dungeon(&d);
+        free(d.rooms);
+        d.rooms = NULL;
+      }
+      rate[e] = BENCH_LEVELS / (wall_time() - start);
+
+      delete_dungeon(&d);
+    }
+
+    printf("%-10s", argv[i]);
+    for (e = 0; e < num_corridor_engines; e++) {
+      printf("%19.0f", rate[e]);
+    }
+    printf("%9.2fx\n", rate[corridor_engine_astar] /
+                       rate[corridor_engine_dijkstra]);
+  }
+
+  return 0;
+}
+
+/* Times smooth_hardness() with each hardness engine at each size on  *
+ * the command line (default 80x21, 400x200 and 1024x1024), smoothing *
+ * the same seeds with each, and verifies that every engine builds    *
+ * the same maps as the list engine.                                   */
+int bench_hardness(int argc, char *argv[])
+{
+  static const char *default_size[] = { "80x21", "400x200", "1024x1024" };
+  uint16_t width, height;
+  uint64_t digest[num_hardness_engines];
+  double start, elapsed[num_hardness_engines];
+  uint32_t n;
+  size_t j;
+  int i, e, mismatch;
+
+  if (!argc) {
+    argc = sizeof (default_size) / sizeof (default_size[0]);
+    argv = (char **) default_size;
+  }
+
+  printf("%-10s", "size");
+  for (e = 0; e < num_hardness_engines; e++) {
+    printf("%10s us", hardness_engine_name[e]);
+  }
+  printf("%10s\n", "speedup");
+
+  for (mismatch = i = 0; i < argc; i++) {
+    if (bench_parse_size("hardness", argv[i], &width, &height)) {
+      return 1;
+    }
+
+    for (e = 0; e < num_hardness_engines; e++) {
+      dungeon d;
+
+      d.width = width;
+      d.height = height;
+      d.hardness_engine = (hardness_engine_t) e;
+      d.hardness.resize(width, height, 0);
+
+      digest[e] = 0;
+      elapsed[e] = 0;
+      for (n = 0; n < BENCH_HARDNESS; n++) {
+        d.rand.seed(n);
+        start = wall_time();
+        smooth_hardness(&d);
+        elapsed[e] += wall_time() - start;
+        for (j = 0; j < d.hardness.size(); j++) {
+          digest[e] = digest[e] * 31 + d.hardness.data()[j];
+        }
+      }
+      elapsed[e] *= 1000000.0 / BENCH_HARDNESS;
+
+      if (digest[e] != digest[hardness_engine_list]) {
+        fprintf(stderr, "%s: %s engine disagrees with list engine\n",
+                argv[i], hardness_engine_name[e]);
+        mismatch = 1;
+      }
+    }
+
+    printf("%-10s", argv[i]);
+    for (e = 0; e < num_hardness_engines; e++) {
+      printf("%13.1f", elapsed[e]);
+    }
+    printf("%9.2fx\n", elapsed[hardness_engine_list] /
+                       elapsed[hardness_engine_array]);
+  }
+
+  return mismatch;
+}
+
+/* Times gen_dungeon() with each room engine at each size on the command *
+ * line (default 80x21, 400x200 and 1024x1024), generating the same     *
+ * seeds with each.  The restart engine only ever finishes with the few *
+ * rooms of a classic map, so it's skipped on larger ones.               */
+int bench_rooms(int argc, char *argv[])
+{
+  static const char *default_size[] = { "80x21", "400x200", "1024x1024" };
+  uint16_t width, height;
+  double start, rate[num_room_engines];
+  uint32_t n, levels, rooms;
+  int i, e;
+
+  if (!argc) {
+    argc = sizeof (default_size) / sizeof (default_size[0]);
+    argv = (char **) default_size;
+  }
+
+  printf("%-10s%8s", "size", "rooms");
+  for (e = 0; e < num_room_engines; e++) {
+    printf("%10s levels/s", room_engine_name[e]);
+  }
+  printf("\n");
+
+  for (i = 0; i < argc; i++) {
+    if (bench_parse_size("rooms", argv[i], &width, &height)) {
+      return 1;
+    }
+
+    /* Aim for about a second per engine. */
+    levels = (BENCH_LEVELS * DUNGEON_X * DUNGEON_Y) / (width * height) + 1;
+
+    for (e = 0; e < num_room_engines; e++) {
+      dungeon d;
+
+      if (e == room_engine_restart &&
+          (width != DUNGEON_X || height != DUNGEON_Y)) {
+        rate[e] = 0;
+        continue;
+      }
+
+      d.width = width;
+      d.height = height;
+      d.room_engine = (room_engine_t) e;
+      init_dungeon(&d);
+
+      start = wall_time();
+      for (rooms = n = 0; n < levels; n++) {
+        d.rand.seed(n);
+        gen_dungeon(&d);
+        rooms += d.num_rooms;
+        free(d.rooms);
+        d.rooms = NULL;
+      }
+      rate[e] = levels / (wall_time() - start);
+
+      delete_dungeon(&d);
+    }
+
+    printf("%-10s%8u", argv[i], rooms / levels);
+    for (e = 0; e < num_room_engines; e++) {
+      if (rate[e]) {
+        printf("%19.1f", rate[e]);
+      } else {
+        printf("%19s", "-");
+      }
+    }
+    printf("\n");
+  }
+
+  return 0;
+}
+
+/* Loads one level for bench_load(), into a dungeon of its own, and *
+ * returns how long the load itself took.                           */
+static double bench_load_level(dungeon *proto, char *file,
+                               const uint8_t *image, uint32_t size)
+{
+  dungeon d;
+  double start, elapsed;
+
+  d.monster_descriptions = proto->monster_descriptions;
+  d.object_descriptions = proto->object_descriptions;
+  init_dungeon(&d);
+
+  start = wall_time();
+  if (file) {
+    read_dungeon(&d, file);
+  } else {
+    read_dungeon_image(&d, image, size);
+  }
+  elapsed = wall_time() - start;
+
+  /* Checkpoints bring a PC; the same dance as at the end of main(). */
+  if (d.PC && pc_is_alive(&d)) {
+    character_delete(d.PC);
+  }
+  delete_dungeon(&d);
+
+  return elapsed;
+}
+
+/* Times loading every level named on the command line: save files one *
+ * at a time, and every level of each pack through a single mapping.   */
+int bench_load(int argc, char *argv[])
+{
+  dungeon proto;
+  std::string path;
+  const uint8_t *image;
+  int64_t number;
+  uint32_t n, levels, size;
+  double elapsed;
+  pack_t p;
+  int i;
+
+  if (!argc) {
+    fprintf(stderr, "bench load: expected one or more .rlg327 or %s files\n",
+            PACK_EXTENSION);
+    return 1;
+  }
+
+  parse_descriptions(&proto);
+
+  printf("%-32s%10s%14s\n", "file", "levels", "us/level");
+
+  for (i = 0; i < argc; i++) {
+    if (pack_name(argv[i], &path, &number) && number < 0) {
+      pack_open(&p, path.c_str());
+      for (elapsed = 0, n = 0; n < p.count; n++) {
+        image = pack_level(&p, n, &size);
+        elapsed += bench_load_level(&proto, NULL, image, size);
+      }
+      levels = p.count;
+      pack_close(&p);
+    } else {
+      elapsed = bench_load_level(&proto, argv[i], NULL, 0);
+      levels = 1;
+    }
+
+    printf("%-32s%10u%14.2f\n", argv[i], levels,
+           levels ? elapsed * 1000000.0 / levels : 0.0);
+  }
+
+  destroy_descriptions(&proto);
+
+  return 0;
+}
+
+/* Saves each dungeon or checkpoint named on the command line with each *
+ * encoding, and times loading the result.  The last column is how fast *
+ * the run-length coded hardness plane decodes on its own.              */
+int bench_encoding(int argc, char *argv[])
+{
+  std::vector<uint8_t> image[num_save_encodings], plane;
+  double start, load[num_save_encodings], rate;
+  uint32_t n, passes, game;
+  dungeon proto;
+  int i, e;
+
+  if (!argc) {
+    fprintf(stderr, "bench encoding: expected one or more .rlg327 files\n");
+    return 1;
+  }
+
+  parse_descriptions(&proto);
+
+  printf("%-32s", "file");
+  for (e = 0; e < num_save_encodings; e++) {
+    printf("%7s bytes", save_encoding_name[e]);
+  }
+  printf("%7s", "ratio");
+  for (e = 0; e < num_save_encodings; e++) {
+    printf("%7s load us", save_encoding_name[e]);
+  }
+  printf("%14s\n", "decode MB/s");
+
+  for (i = 0; i < argc; i++) {
+    dungeon d;
+
+    d.monster_descriptions = proto.monster_descriptions;
+    d.object_descriptions = proto.object_descriptions;
+    init_dungeon(&d);
+    /* Checkpoints bring their own PC.  Dungeons get one at (0, 0). */
+    d.PC = NULL;
+    read_dungeon(&d, argv[i]);
+    if (!(game = d.PC != NULL)) {
+      d.PC = new pc;
+      d.PC->position[dim_x] = d.PC->position[dim_y] = 0;
+    }
+
+    for (e = 0; e < num_save_encodings; e++) {
+      d.save_encoding = (save_encoding_t) e;
+      if (game) {
+        game_image(&d, image[e]);
+      } else {
+        dungeon_image(&d, image[e]);
+      }
+
+      for (load[e] = 0, n = 0; n < BENCH_ENCODING; n++) {
+        load[e] += bench_load_level(&proto, NULL,
+                                    image[e].data(), image[e].size());
+      }
+      load[e] *= 1000000.0 / BENCH_ENCODING;
+    }
+
+    /* Enough passes to decode about BENCH_DECODE bytes, since a single *
+     * small plane takes too little time to measure.                    */
+    rle_encode_plane(d.hardness.data(), d.hardness.size(), 8, plane);
+    passes = BENCH_DECODE / d.hardness.size() + 1;
+    start = wall_time();
+    for (n = 0; n < passes; n++) {
+      rle_decode_plane(plane.data(), plane.size(), 8,
+                       d.hardness.data(), d.hardness.size());
+    }
+    rate = (d.hardness.size() * (double) passes /
+            (wall_time() - start) / 1000000.0);
+
+    printf("%-32s", argv[i]);
+    for (e = 0; e < num_save_encodings; e++) {
+      printf("%13zu", image[e].size());
+    }
+    printf("%6.2fx", ((double) image[save_encoding_raw].size() /
+                      image[save_encoding_rle].size()));
+    for (e = 0; e < num_save_encodings; e++) {
+      printf("%15.2f", load[e]);
+    }
+    printf("%14.0f\n", rate);
+
+    if (game) {
+      if (pc_is_alive(&d)) {
+        character_delete(d.PC);
+      }
+    } else {
+      delete d.PC;
+    }
+    d.PC = NULL;
+    delete_dungeon(&d);
+  }
+
+  destroy_descriptions(&proto);
+
+  return 0;
+}
+
+/* Imports a checkerboard PGM, in which every black pixel is a room of *
+ * its own, at each size on the command line (default 80x21, and      *
+ * 364x364, which comes to just under the most rooms a save can hold), *
+ * then saves it with each encoding and loads it back.  The rooms, the  *
+ * hardness and the terrain all have to survive the trip.               */
+int bench_pgm(int argc, char *argv[])
+{
+  static const char *default_size[] = { "80x21", "364x364" };
+  std::vector<uint8_t> image, row;
+  double start, elapsed;
+  uint16_t width, height;
+  uint32_t x, y;
+  char name[32];
+  int i, e, fd, mismatch;
+  FILE *f;
+
+  if (!argc) {
+    argc = sizeof (default_size) / sizeof (default_size[0]);
+    argv = (char **) default_size;
+  }
+
+  printf("%-10s%10s%14s\n", "size", "rooms", "import us");
+
+  for (mismatch = i = 0; i < argc; i++) {
+    dungeon d;
+
+    if (bench_parse_size("pgm", argv[i], &width, &height)) {
+      return 1;
+    }
+
+    strcpy(name, "/tmp/rlg327-pgm-XXXXXX");
+    if ((fd = mkstemp(name)) < 0 || !(f = fdopen(fd, "w"))) {
+      perror(name);
+      return 1;
+    }
+    fprintf(f, "P5\n%u %u\n255\n", width - 2, height - 2);
+    row.resize(width - 2);
+    for (y = 0; y < height - 2U; y++) {
+      for (x = 0; x < width - 2U; x++) {
+        row[x] = (x + y) % 2 ? 255 : 0;
+      }
+      fwrite(row.data(), 1, row.size(), f);
+    }
+    fclose(f);
+
+    init_dungeon(&d);
+    start = wall_time();
+    read_pgm(&d, name);
+    elapsed = wall_time() - start;
+    unlink(name);
+    d.PC = new pc;
+    d.PC->position[dim_x] = d.PC->position[dim_y] = 1;
+
+    for (e = 0; e < num_save_encodings; e++) {
+      dungeon copy;
+
+      d.save_encoding = (save_encoding_t) e;
+      dungeon_image(&d, image);
+      init_dungeon(&copy);
+      read_dungeon_image(&copy, image.data(), image.size());
+      if (copy.num_rooms != d.num_rooms                              ||
+          memcmp(copy.rooms, d.rooms, sizeof (*d.rooms) * d.num_rooms) ||
+          memcmp(copy.hardness.data(), d.hardness.data(),
+                 d.hardness.size())                                  ||
+          memcmp(copy.map.data(), d.map.data(),
+                 sizeof (*d.map.data()) * d.map.size())) {
+        fprintf(stderr, "%s: the %s save doesn't load back as saved\n",
+                argv[i], save_encoding_name[e]);
+        mismatch = 1;
+      }
+      delete_dungeon(&copy);
+    }
+
+    printf("%-10s%10u%14.0f\n", argv[i], d.num_rooms, elapsed * 1000000.0);
+
+    delete d.PC;
+    d.PC = NULL;
+    delete_dungeon(&d);
+  }
+
+  return mismatch;
+}
+
+/* Prints every description, for comparing two loads. */
+static std::string bench_print_descriptions(dungeon *d)
+{
+  std::vector<monster_description>::iterator mi;
+  std::vector<object_description>::iterator oi;
+  std::stringstream s;
+
+  for (mi = d->monster_descriptions.begin();
+       mi != d->monster_descriptions.end();
+       mi++) {
+    s << *mi << std::endl;
+  }
+  for (oi = d->object_descriptions.begin();
+       oi != d->object_descriptions.end();
+       oi++) {
+    s << *oi << std::endl;
+  }
+
+  return s.str();
+}
+
+/* Times loading the description files by parsing the text and through *
+ * the binary cache, and checks that both give the same descriptions.  */
+int bench_descriptions(int argc, char *argv[])
+{
+  std::string parsed, cached;
+  double start, elapsed[2];
+  uint32_t n;
+  int c;
+
+  if (argc) {
+    fprintf(stderr, "bench descriptions: takes no arguments\n");
+    return 1;
+  }
+
+  /* Make sure the cache is there before timing it. */
+  {
+    dungeon d;
+
+    if (parse_descriptions(&d)) {
+      return 1;
+    }
+  }
+
+  for (c = 0; c < 2; c++) {
+    start = wall_time();
+    for (n = 0; n < BENCH_DESCRIPTIONS; n++) {
+      dungeon d;
+
+      parse_descriptions(&d, c);
+      if (!n) {
+        (c ? cached : parsed) = bench_print_descriptions(&d);
+      }
+    }
+    elapsed[c] = (wall_time() - start) * 1000000.0 / BENCH_DESCRIPTIONS;
+  }
+
+  printf("%-12s%14s\n", "load", "us");
+  printf("%-12s%14.2f\n", "text", elapsed[0]);
+  printf("%-12s%14.2f\n", "cache", elapsed[1]);
+
+  if (parsed != cached) {
+    fprintf(stderr, "The cache doesn't match the text.\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+/* A random open cell of d, to look from. */
+static void bench_open_cell(dungeon *d, pair_t p)
+{
+  do {
+    p[dim_x] = d->rand.range(1, d->width - 2);
+    p[dim_y] = d->rand.range(1, d->height - 2);
+  } while (mappair(p) < ter_floor);
+}
+
+/* Times can_see() with each LOS engine, at the PC's range and at the    *
+ * monsters', on a dungeon of each size given on the command line        *
+ * (default 80x21 and 400x200), and then the PC's terrain learning.       *
+ * Every engine has to give the same answers, and leave the PC knowing  *
+ * and seeing the same cells, as the bresenham engine.                   */
+int bench_los(int argc, char *argv[])
+{
+  static const char *default_size[] = { "80x21", "400x200" };
+  static const int is_pc[] = { 1, 0 };
+  std::vector<int16_t> query;
+  std::vector<uint8_t> seen[num_los_engines];
+  grid<terrain_type> known;
+  grid<uint8_t> visible;
+  double start, rate[num_los_engines][3];
+  uint16_t width, height;
+  int32_t range;
+  uint32_t n, q;
+  int i, e, m, mismatch;
+
+  if (!argc) {
+    argc = sizeof (default_size) / sizeof (default_size[0]);
+    argv = (char **) default_size;
+  }
+
+  printf("%-10s", "size");
+  for (e = 0; e < num_los_engines; e++) {
+    printf("%12s PC q/s%11s NPC q/s%13s obs/s", los_engine_name[e],
+           los_engine_name[e], los_engine_name[e]);
+  }
+  printf("\n");
+
+  for (mismatch = i = 0; i < argc; i++) {
+    dungeon d;
+
+    if (bench_parse_size("los", argv[i], &width, &height)) {
+      return 1;
+    }
+
+    d.width = width;
+    d.height = height;
+    init_dungeon(&d);
+    d.rand.seed(i);
+    gen_dungeon(&d);
+    d.PC = new pc;
+    pc_init_known_terrain(d.PC, &d);
+
+    for (m = 0; m < 2; m++) {
+      /* From open cells to anywhere in range, so some lines are *
+       * blocked and some aren't, as in the game.                */
+      range = is_pc[m] ? PC_VISUAL_RANGE : NPC_VISUAL_RANGE;
+      query.resize(4 * BENCH_LOS_QUERIES);
+      for (q = 0; q < query.size(); q += 4) {
+        bench_open_cell(&d, &query[q]);
+        query[q + 2] = d.rand.range(std::max(query[q] - range, 0),
+                                    std::min(query[q] + range,
+                                             d.width - 1));
+        query[q + 3] = d.rand.range(std::max(query[q + 1] - range, 0),
+                                    std::min(query[q + 1] + range,
+                                             d.height - 1));
+      }
+
+      for (e = 0; e < num_los_engines; e++) {
+        d.los_engine = (los_engine_t) e;
+        seen[e].resize(BENCH_LOS_QUERIES);
+        start = wall_time();
+        for (q = 0; q < BENCH_LOS_QUERIES; q++) {
+          seen[e][q] = can_see(&d, &query[4 * q], &query[4 * q + 2],
+                               is_pc[m], 0);
+        }
+        rate[e][m] = BENCH_LOS_QUERIES / (wall_time() - start);
+
+        if (e != los_engine_bresenham &&
+            seen[e] != seen[los_engine_bresenham]) {
+          fprintf(stderr, "%s: %s engine disagrees with bresenham engine "
+                  "at %s range\n", argv[i], los_engine_name[e],
+                  is_pc[m] ? "PC" : "NPC");
+          mismatch = 1;
+        }
+      }
+    }
+
+    for (e = 0; e < num_los_engines; e++) {
+      d.los_engine = (los_engine_t) e;
+      pc_init_known_terrain(d.PC, &d);
+      d.rand.seed(i);
+      start = wall_time();
+      for (n = 0; n < BENCH_LOS_OBSERVES; n++) {
+        bench_open_cell(&d, d.PC->position);
+        pc_observe_terrain(d.PC, &d);
+      }
+      rate[e][2] = BENCH_LOS_OBSERVES / (wall_time() - start);
+
+      if (e == los_engine_bresenham) {
+        known = d.PC->known_terrain;
+        visible = d.PC->visible;
+      } else if (memcmp(known.data(), d.PC->known_terrain.data(),
+                        known.size() * sizeof (terrain_type)) ||
+                 memcmp(visible.data(), d.PC->visible.data(),
+                        visible.size())) {
+        fprintf(stderr, "%s: %s engine learns different terrain from "
+                "bresenham engine\n", argv[i], los_engine_name[e]);
+        mismatch = 1;
+      }
+    }
+
+    printf("%-10s", argv[i]);
+    for (e = 0; e < num_los_engines; e++) {
+      printf("%19.0f%19.0f%19.0f", rate[e][0], rate[e][1], rate[e][2]);
+    }
+    printf("\n");
+
+    delete d.PC;
+    d.PC = NULL;
+    free(d.rooms);
+    d.rooms = NULL;
+    delete_dungeon(&d);
+  }
+
+  return mismatch;
+}
@@ -0,0 +1,19 @@
+#ifndef BENCH_H
+# define BENCH_H
+
+# include <stdint.h>
+
+/* Microbenchmarks, run with "rlg327 --bench <name> [args...]".  Each *
+ * takes the arguments that follow its name and returns an exit code. */
+int bench_path(int argc, char *argv[]);
+int bench_events(int argc, char *argv[]);
+int bench_corridors(int argc, char *argv[]);
+int bench_hardness(int argc, char *argv[]);
+int bench_rooms(int argc, char *argv[]);
+int bench_load(int argc, char *argv[]);
+int bench_encoding(int argc, char *argv[]);
+int bench_descriptions(int argc, char *argv[]);
+int bench_los(int argc, char *argv[]);
+int bench_pgm(int argc, char *argv[]);
+
+#endif
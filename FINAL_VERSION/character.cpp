@@ -97,6 +97,10 @@ uint32_t can_see(dungeon *d, pair_t voyeur, pair_t exhibitionist,
   int16_t a, b, c, i;
   int16_t visual_range;
 
+  if (d->los_engine == los_engine_table) {
+    return los_can_see(d, voyeur, exhibitionist, is_pc, learn);
+  }
+
   visual_range = is_pc ? PC_VISUAL_RANGE : NPC_VISUAL_RANGE;
 
   first[dim_x] = voyeur[dim_x];
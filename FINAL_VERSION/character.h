@@ -7,6 +7,7 @@
 
 # include "dims.h"
 # include "utils.h"
+# include "rng.h"
 
 typedef enum kill_type {
   kill_direct,
@@ -18,6 +19,7 @@ class dice;
 
 class character {
  public:
+  character() : poisonDamage(0) {}
   virtual ~character() {}
   char symbol;
   pair_t position;
@@ -37,7 +39,7 @@ class character {
    * characters have been created by the game.                              */
   uint32_t sequence_number;
   uint32_t kills[num_kill_types];
-  inline uint32_t get_color() { return color[rand_range(0, color.size() - 1)]; }
+  inline uint32_t get_color(rng &r) { return color[r.range(0, color.size() - 1)]; }
   inline char get_symbol() { return symbol; }
 };
 
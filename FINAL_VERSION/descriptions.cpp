@@ -8,6 +8,12 @@
 #include <vector>
 #include <sstream>
 #include <cstdlib>
+#include <cerrno>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "descriptions.h"
 #include "dungeon.h"
@@ -24,6 +30,24 @@
 #define OBJECT_FILE_VERSION            1U
 #define NUM_OBJECT_DESCRIPTION_FIELDS  14
 
+/* A description cache is a header, big-endian like the save files:    *
+ *                                                                      *
+ *   0-11   the semantic, DESC_CACHE_SEMANTIC                           *
+ *   12-15  the version, DESC_CACHE_VERSION                             *
+ *   16-23  the text file's mtime, seconds                              *
+ *   24-27  and nanoseconds                                             *
+ *   28-35  the text file's size                                        *
+ *   36-43  the FNV-1a hash of the text                                 *
+ *   44-47  the number of descriptions                                  *
+ *   48-55  the FNV-1a hash of the rest of the cache                    *
+ *                                                                      *
+ * followed by the descriptions, each as written by cache_put().  The   *
+ * cache is only used when all of the text file's numbers still match, *
+ * and when its own hash does, so a damaged cache is simply rebuilt.   */
+#define DESC_CACHE_SEMANTIC            "RLGDSC-" TERM
+#define DESC_CACHE_VERSION             0U
+#define DESC_CACHE_HEADER_SIZE         (sizeof (DESC_CACHE_SEMANTIC) - 1 + 44)
+
 static const struct {
   const char *name;
   const uint32_t value;
@@ -877,41 +901,380 @@ static uint32_t parse_object_descriptions(std::ifstream &f,
   return 0;
 }
 
-uint32_t parse_descriptions(dungeon *d)
+static void cache_be32(std::vector<uint8_t> &image, uint32_t v)
+{
+  v = htobe32(v);
+  image.insert(image.end(), (uint8_t *) &v, (uint8_t *) &v + sizeof (v));
+}
+
+static void cache_be64(std::vector<uint8_t> &image, uint64_t v)
+{
+  v = htobe64(v);
+  image.insert(image.end(), (uint8_t *) &v, (uint8_t *) &v + sizeof (v));
+}
+
+static void cache_string(std::vector<uint8_t> &image, const std::string &s)
+{
+  cache_be32(image, s.length());
+  image.insert(image.end(), s.begin(), s.end());
+}
+
+static void cache_dice(std::vector<uint8_t> &image, const dice &d)
+{
+  cache_be32(image, d.get_base());
+  cache_be32(image, d.get_number());
+  cache_be32(image, d.get_sides());
+}
+
+static int take_be32(const uint8_t **p, const uint8_t *end, uint32_t *v)
+{
+  if (end - *p < (ptrdiff_t) sizeof (*v)) {
+    return 1;
+  }
+  memcpy(v, *p, sizeof (*v));
+  *v = be32toh(*v);
+  *p += sizeof (*v);
+
+  return 0;
+}
+
+static int take_be64(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+  if (end - *p < (ptrdiff_t) sizeof (*v)) {
+    return 1;
+  }
+  memcpy(v, *p, sizeof (*v));
+  *v = be64toh(*v);
+  *p += sizeof (*v);
+
+  return 0;
+}
+
+static int take_string(const uint8_t **p, const uint8_t *end, std::string *s)
+{
+  uint32_t len;
+
+  if (take_be32(p, end, &len) || (uint32_t) (end - *p) < len) {
+    return 1;
+  }
+  s->assign((const char *) *p, len);
+  *p += len;
+
+  return 0;
+}
+
+static int take_dice(const uint8_t **p, const uint8_t *end, dice *d)
+{
+  uint32_t base, number, sides;
+
+  if (take_be32(p, end, &base)   ||
+      take_be32(p, end, &number) ||
+      take_be32(p, end, &sides)) {
+    return 1;
+  }
+  d->set((int32_t) base, number, sides);
+
+  return 0;
+}
+
+void monster_description::cache_put(std::vector<uint8_t> &image) const
+{
+  std::vector<uint32_t>::const_iterator ci;
+
+  cache_string(image, name);
+  cache_string(image, description);
+  image.push_back(symbol);
+  cache_be32(image, color.size());
+  for (ci = color.begin(); ci != color.end(); ci++) {
+    cache_be32(image, *ci);
+  }
+  cache_be32(image, abilities);
+  cache_dice(image, speed);
+  cache_dice(image, hitpoints);
+  cache_dice(image, damage);
+  cache_be32(image, rarity);
+}
+
+int monster_description::cache_take(const uint8_t **p, const uint8_t *end)
+{
+  uint32_t i, colors;
+
+  if (take_string(p, end, &name) || take_string(p, end, &description) ||
+      *p == end) {
+    return 1;
+  }
+  symbol = *(*p)++;
+  /* Every color takes four bytes, which bounds a bad count. */
+  if (take_be32(p, end, &colors) || colors > (uint32_t) (end - *p) / 4) {
+    return 1;
+  }
+  color.resize(colors);
+  for (i = 0; i < colors; i++) {
+    take_be32(p, end, &color[i]);
+  }
+
+  return (take_be32(p, end, &abilities) ||
+          take_dice(p, end, &speed)     ||
+          take_dice(p, end, &hitpoints) ||
+          take_dice(p, end, &damage)    ||
+          take_be32(p, end, &rarity));
+}
+
+void object_description::cache_put(std::vector<uint8_t> &image) const
+{
+  cache_string(image, name);
+  cache_string(image, description);
+  cache_be32(image, type);
+  cache_be32(image, color);
+  cache_dice(image, hit);
+  cache_dice(image, damage);
+  cache_dice(image, dodge);
+  cache_dice(image, defence);
+  cache_dice(image, weight);
+  cache_dice(image, speed);
+  cache_dice(image, attribute);
+  cache_dice(image, value);
+  image.push_back(artifact);
+  cache_be32(image, rarity);
+}
+
+int object_description::cache_take(const uint8_t **p, const uint8_t *end)
+{
+  uint32_t t;
+
+  if (take_string(p, end, &name)        ||
+      take_string(p, end, &description) ||
+      take_be32(p, end, &t)             ||
+      t > objtype_CONTAINER             ||
+      take_be32(p, end, &color)         ||
+      take_dice(p, end, &hit)           ||
+      take_dice(p, end, &damage)        ||
+      take_dice(p, end, &dodge)         ||
+      take_dice(p, end, &defence)       ||
+      take_dice(p, end, &weight)        ||
+      take_dice(p, end, &speed)         ||
+      take_dice(p, end, &attribute)     ||
+      take_dice(p, end, &value)         ||
+      *p == end) {
+    return 1;
+  }
+  type = (object_type_t) t;
+  artifact = *(*p)++;
+
+  return take_be32(p, end, &rarity);
+}
+
+/* 64-bit FNV-1a, of the text and of the cache itself.  The mtime and  *
+ * size catch nearly every edit; the hash catches the rest, like a      *
+ * same-sized edit within the mtime's grain.                            */
+static uint64_t hash_bytes(const uint8_t *p, size_t size)
+{
+  uint64_t h;
+  size_t i;
+
+  for (h = 0xcbf29ce484222325ULL, i = 0; i < size; i++) {
+    h = (h ^ p[i]) * 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+/* Maps a whole file read-only.  Returns non-zero, quietly, if it can't; *
+ * an empty file can't be mapped, and is never a valid cache anyway.     */
+static int map_file(const std::string &file, struct stat *buf,
+                    const uint8_t **image)
+{
+  void *m;
+  int fd;
+
+  if ((fd = open(file.c_str(), O_RDONLY)) < 0) {
+    return 1;
+  }
+  if (fstat(fd, buf) || !buf->st_size ||
+      (m = mmap(NULL, buf->st_size, PROT_READ, MAP_PRIVATE,
+                fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return 1;
+  }
+  close(fd);
+  *image = (const uint8_t *) m;
+
+  return 0;
+}
+
+/* Hashes the text file whose stat() is buf, or returns non-zero if it *
+ * can't be read.                                                      */
+static int text_key(const std::string &file, struct stat *buf,
+                    uint64_t *hash)
+{
+  const uint8_t *text;
+
+  if (map_file(file, buf, &text)) {
+    return 1;
+  }
+  *hash = hash_bytes(text, buf->st_size);
+  munmap((void *) text, buf->st_size);
+
+  return 0;
+}
+
+/* Rebuilds v from the cache for the text file file, returning non-zero *
+ * and leaving v empty if the cache is missing, stale or damaged.       */
+template <class T>
+static int read_description_cache(const std::string &file, std::vector<T> *v)
+{
+  const uint8_t *image, *p, *end;
+  struct stat text, cache;
+  uint64_t sec, size, hash, body;
+  uint32_t version, nsec, count, i;
+  int failed;
+
+  if (stat(file.c_str(), &text) ||
+      map_file(file + DESC_CACHE_SUFFIX, &cache, &image)) {
+    return 1;
+  }
+
+  p = image;
+  end = image + cache.st_size;
+  failed = 1;
+  if ((size_t) cache.st_size >= DESC_CACHE_HEADER_SIZE                   &&
+      !memcmp(p, DESC_CACHE_SEMANTIC, sizeof (DESC_CACHE_SEMANTIC) - 1)) {
+    p += sizeof (DESC_CACHE_SEMANTIC) - 1;
+    take_be32(&p, end, &version);
+    take_be64(&p, end, &sec);
+    take_be32(&p, end, &nsec);
+    take_be64(&p, end, &size);
+    take_be64(&p, end, &hash);
+    take_be32(&p, end, &count);
+    take_be64(&p, end, &body);
+
+    /* Hashing waits until the cheap comparisons have passed. */
+    if (version == DESC_CACHE_VERSION                            &&
+        sec == (uint64_t) text.st_mtim.tv_sec                    &&
+        nsec == (uint32_t) text.st_mtim.tv_nsec                  &&
+        size == (uint64_t) text.st_size                          &&
+        body == hash_bytes(p, end - p)                            &&
+        !text_key(file, &text, &sec) && sec == hash) {
+      v->resize(count < cache.st_size ? count : 0);
+      for (failed = 0, i = 0; !failed && i < count; i++) {
+        failed = (i >= v->size() || (*v)[i].cache_take(&p, end));
+      }
+      failed = failed || p != end;
+    }
+  }
+  munmap((void *) image, cache.st_size);
+
+  if (failed) {
+    v->clear();
+  }
+
+  return failed;
+}
+
+/* Writes v as the cache for file.  It's written aside and renamed into *
+ * place, so that a game starting alongside never sees half of it.      *
+ * Failing to write it isn't an error; the text is parsed next time.    */
+template <class T>
+static void write_description_cache(const std::string &file,
+                                    const std::vector<T> &v)
+{
+  std::vector<uint8_t> image;
+  typename std::vector<T>::const_iterator i;
+  std::stringstream tmp;
+  struct stat text;
+  const uint8_t *p;
+  uint64_t hash;
+  ssize_t n;
+  int fd;
+
+  if (text_key(file, &text, &hash)) {
+    return;
+  }
+
+  image.insert(image.end(), DESC_CACHE_SEMANTIC,
+               DESC_CACHE_SEMANTIC + sizeof (DESC_CACHE_SEMANTIC) - 1);
+  cache_be32(image, DESC_CACHE_VERSION);
+  cache_be64(image, text.st_mtim.tv_sec);
+  cache_be32(image, text.st_mtim.tv_nsec);
+  cache_be64(image, text.st_size);
+  cache_be64(image, hash);
+  cache_be32(image, v.size());
+  cache_be64(image, 0);
+  for (i = v.begin(); i != v.end(); i++) {
+    i->cache_put(image);
+  }
+  hash = hash_bytes(image.data() + DESC_CACHE_HEADER_SIZE,
+                   image.size() - DESC_CACHE_HEADER_SIZE);
+  hash = htobe64(hash);
+  memcpy(image.data() + DESC_CACHE_HEADER_SIZE - sizeof (hash),
+         &hash, sizeof (hash));
+
+  tmp << file << DESC_CACHE_SUFFIX << "." << getpid();
+  if ((fd = open(tmp.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+    return;
+  }
+  for (p = image.data(); p < image.data() + image.size(); p += n) {
+    if ((n = write(fd, p, image.data() + image.size() - p)) < 0) {
+      if (errno == EINTR) {
+        n = 0;
+        continue;
+      }
+      break;
+    }
+  }
+  if (close(fd) || p != image.data() + image.size() ||
+      rename(tmp.str().c_str(), (file + DESC_CACHE_SUFFIX).c_str())) {
+    unlink(tmp.str().c_str());
+  }
+}
+
+template <class T>
+static uint32_t load_descriptions(dungeon *d, const char *name,
+                                  std::vector<T> *v, bool use_cache,
+                                  uint32_t (*parse)(std::ifstream &f,
+                                                    dungeon *d,
+                                                    std::vector<T> *v))
 {
   std::string file;
   std::ifstream f;
   uint32_t retval;
 
-  retval = 0;
-
   file = getenv("HOME");
   if (file.length() == 0) {
     file = ".";
   }
-  file += std::string("/") + SAVE_DIR + "/" + MONSTER_DESC_FILE;
-
-  f.open(file.c_str());
+  file += std::string("/") + SAVE_DIR + "/" + name;
 
-  if (parse_monster_descriptions(f, d, &d->monster_descriptions)) {
-    retval = 1;
+  if (use_cache && !read_description_cache(file, v)) {
+    return 0;
   }
 
+  f.open(file.c_str());
+  retval = parse(f, d, v);
   f.close();
 
-  file = getenv("HOME");
-  if (file.length() == 0) {
-    file = ".";
+  if (use_cache && !retval) {
+    write_description_cache(file, *v);
   }
-  file += std::string("/") + SAVE_DIR + "/" + OBJECT_DESC_FILE;
 
-  f.open(file.c_str());
+  return retval;
+}
 
-  if (parse_object_descriptions(f, d, &d->object_descriptions)) {
+uint32_t parse_descriptions(dungeon *d, bool use_cache)
+{
+  uint32_t retval;
+
+  retval = 0;
+
+  if (load_descriptions(d, MONSTER_DESC_FILE, &d->monster_descriptions,
+                        use_cache, parse_monster_descriptions)) {
     retval = 1;
   }
 
-  f.close();
+  if (load_descriptions(d, OBJECT_DESC_FILE, &d->object_descriptions,
+                        use_cache, parse_object_descriptions)) {
+    retval = 1;
+  }
 
   return retval;
 }
@@ -1064,21 +1427,21 @@ std::ostream &operator<<(std::ostream &o, object_description &od)
   return od.print(o);
 }
 
-npc *monster_description::generate_monster(dungeon *d)
+npc *monster_description::generate_monster(dungeon *d, pair_t p)
 {
   npc *n;
   std::vector<monster_description> &v = d->monster_descriptions;
   uint32_t i;
 
-  while (!v[(i = (rand() % v.size()))].can_be_generated() ||
-         !v[i].pass_rarity_roll())
+  while (!v[(i = (d->rand.next() % v.size()))].can_be_generated() ||
+         !v[i].pass_rarity_roll(d->rand))
     ;
 
   monster_description &m = v[i];
 
-  n = new npc(d, m);
+  n = new npc(d, m, p);
 
-  heap_insert(&d->events, new_event(d, event_character_turn, n, 0));
+  eventq_insert(&d->events, new_event(d, event_character_turn, n, 0));
 
   return n;
 }
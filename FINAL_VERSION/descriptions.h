@@ -7,10 +7,15 @@
 
 # include "dice.h"
 # include "npc.h"
+# include "rng.h"
 
 class dungeon;
 
-uint32_t parse_descriptions(dungeon *d);
+/* Loads both description files.  Each is turned into a binary cache  *
+ * beside it the first time it's parsed, and later launches map that   *
+ * instead, for as long as the text file's mtime, size and hash match. *
+ * With use_cache false, the text is always parsed and nothing written. */
+uint32_t parse_descriptions(dungeon *d, bool use_cache = true);
 uint32_t print_descriptions(dungeon *d);
 uint32_t destroy_descriptions(dungeon *d);
 
@@ -54,9 +59,9 @@ class monster_description {
     return (((abilities & NPC_UNIQ) && !num_alive && !num_killed) ||
             !(abilities & NPC_UNIQ));
   }
-  inline bool pass_rarity_roll()
+  inline bool pass_rarity_roll(rng &r)
   {
-    return rarity > (unsigned) (rand() % 100);
+    return rarity > r.next() % 100;
   }
 
 public:
@@ -76,6 +81,15 @@ public:
            const uint32_t rarity);
   std::ostream &print(std::ostream &o);
   char get_symbol() { return symbol; }
+  inline const std::string &get_name() { return name; }
+  inline uint32_t get_num_killed() { return num_killed; }
+  inline uint32_t get_num_alive() { return num_alive; }
+  /* Checkpoints put these back after recreating the monsters. */
+  inline void restore(uint32_t alive, uint32_t killed)
+  {
+    num_alive = alive;
+    num_killed = killed;
+  }
   inline void birth()
   {
     num_alive++;
@@ -89,7 +103,11 @@ public:
   {
     num_alive--;
   }
-  static npc *generate_monster(dungeon *d);
+  static npc *generate_monster(dungeon *d, pair_t p);
+  /* Append to and read back from a description cache.  cache_take() *
+   * advances *p, and returns non-zero if it would pass end.         */
+  void cache_put(std::vector<uint8_t> &image) const;
+  int cache_take(const uint8_t **p, const uint8_t *end);
   friend npc;
   friend bool boss_is_alive(dungeon *d);
 };
@@ -117,9 +135,9 @@ class object_description {
   {
     return !artifact || (artifact && !num_generated && !num_found);
   }
-  inline bool pass_rarity_roll()
+  inline bool pass_rarity_roll(rng &r)
   {
-    return rarity > (unsigned) (rand() % 100);
+    return rarity > r.next() % 100;
   }
   void set(const std::string &name,
            const std::string &description,
@@ -153,6 +171,16 @@ class object_description {
   inline void generate() { num_generated++; }
   inline void destroy() { num_generated--; }
   inline void find() { num_found++; }
+  inline uint32_t get_num_generated() const { return num_generated; }
+  inline uint32_t get_num_found() const { return num_found; }
+  /* Checkpoints put these back after recreating the objects. */
+  inline void restore(uint32_t generated, uint32_t found)
+  {
+    num_generated = generated;
+    num_found = found;
+  }
+  void cache_put(std::vector<uint8_t> &image) const;
+  int cache_take(const uint8_t **p, const uint8_t *end);
 };
 
 std::ostream &operator<<(std::ostream &o, monster_description &m);
@@ -3,7 +3,7 @@
 #include "dice.h"
 #include "utils.h"
 
-int32_t dice::roll(void) const
+int32_t dice::roll(rng &r) const
 {
   int32_t total;
   uint32_t i;
@@ -12,13 +12,35 @@ int32_t dice::roll(void) const
 
   if (sides) {
     for (i = 0; i < number; i++) {
-      total += rand_range(1, sides);
+      total += r.range(1, sides);
     }
   }
 
   return total;
 }
 
+void dice::roll(rng &r, int32_t *out, uint32_t count) const
+{
+  uint32_t i, j;
+  int32_t total;
+
+  if (!sides) {
+    for (i = 0; i < count; i++) {
+      out[i] = base;
+    }
+
+    return;
+  }
+
+  /* Same as count calls to roll(), without the call overhead. */
+  for (i = 0; i < count; i++) {
+    for (total = base, j = 0; j < number; j++) {
+      total += r.range(1, sides);
+    }
+    out[i] = total;
+  }
+}
+
 std::ostream &dice::print(std::ostream &o)
 {
   return o << base << '+' << number << 'd' << sides;
@@ -4,6 +4,8 @@
 # include <stdint.h>
 # include <iostream>
 
+# include "rng.h"
+
 class dice {
  private:
   int32_t base;
@@ -34,7 +36,9 @@ class dice {
   {
     this->sides = sides;
   }
-  int32_t roll(void) const;
+  int32_t roll(rng &r) const;
+  /* Fills out[0..count-1] with independent rolls. */
+  void roll(rng &r, int32_t *out, uint32_t count) const;
   std::ostream &print(std::ostream &o);
   inline int32_t get_base() const
   {
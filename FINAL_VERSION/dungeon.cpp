@@ -2,13 +2,20 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include <endian.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <climits>
 #include <sys/time.h>
 #include <cassert>
 #include <cerrno>
+#include <algorithm>
+#include <vector>
+#include <string>
 
 #include "heap.h"
 #include "dungeon.h"
@@ -18,13 +25,17 @@
 #include "npc.h"
 #include "io.h"
 #include "object.h"
+#include "pregen.h"
+#include "save.h"
+#include "pack.h"
+#include "rle.h"
 
 #define DUMP_HARDNESS_IMAGES 0
 
 typedef struct corridor_path {
   heap_node_t *hn;
-  uint8_t pos[2];
-  uint8_t from[2];
+  uint16_t pos[2];
+  uint16_t from[2];
   int32_t cost;
 } corridor_path_t;
 
@@ -63,35 +74,43 @@ static int32_t corridor_path_cmp(const void *key, const void *with) {
   return ((corridor_path_t *) key)->cost - ((corridor_path_t *) with)->cost;
 }
 
-static void dijkstra_corridor(dungeon *d, pair_t from, pair_t to)
+/* Sizes the per-thread scratch grid to the dungeon and resets the costs. */
+static void corridor_path_init(dungeon *d, grid<corridor_path_t> &path)
 {
-  static corridor_path_t path[DUNGEON_Y][DUNGEON_X], *p;
-  static uint32_t initialized = 0;
-  heap_t h;
-  int32_t x, y;
+  uint32_t x, y;
 
-  if (!initialized) {
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
+  if (path.width() != d->width || path.height() != d->height) {
+    path.resize(d->width, d->height, corridor_path_t());
+    for (y = 0; y < d->height; y++) {
+      for (x = 0; x < d->width; x++) {
         path[y][x].pos[dim_y] = y;
         path[y][x].pos[dim_x] = x;
       }
     }
-    initialized = 1;
   }
-  
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       path[y][x].cost = INT_MAX;
     }
   }
+}
+
+static int32_t dijkstra_corridor(dungeon *d, pair_t from, pair_t to)
+{
+  static thread_local grid<corridor_path_t> path;
+  corridor_path_t *p;
+  heap_t h;
+  int32_t x, y;
+
+  corridor_path_init(d, path);
 
   path[from[dim_y]][from[dim_x]].cost = 0;
 
   heap_init(&h, corridor_path_cmp, NULL);
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       if (mapxy(x, y) != ter_wall_immutable) {
         path[y][x].hn = heap_insert(&h, &path[y][x]);
       } else {
@@ -113,7 +132,7 @@ static void dijkstra_corridor(dungeon *d, pair_t from, pair_t to)
         }
       }
       heap_delete(&h);
-      return;
+      return path[to[dim_y]][to[dim_x]].cost;
     }
 
     if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].hn) &&
@@ -157,40 +176,28 @@ static void dijkstra_corridor(dungeon *d, pair_t from, pair_t to)
                                            [p->pos[dim_x]    ].hn);
     }
   }
+
+  return INT_MAX;
 }
 
 /* This is a cut-and-paste of the above.  The code is modified to  *
  * calculate paths based on inverse hardnesses so that we get a    *
  * high probability of creating at least one cycle in the dungeon. */
-static void dijkstra_corridor_inv(dungeon *d, pair_t from, pair_t to)
+static int32_t dijkstra_corridor_inv(dungeon *d, pair_t from, pair_t to)
 {
-  static corridor_path_t path[DUNGEON_Y][DUNGEON_X], *p;
-  static uint32_t initialized = 0;
+  static thread_local grid<corridor_path_t> path;
+  corridor_path_t *p;
   heap_t h;
   int32_t x, y;
 
-  if (!initialized) {
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        path[y][x].pos[dim_y] = y;
-        path[y][x].pos[dim_x] = x;
-      }
-    }
-    initialized = 1;
-  }
-  
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      path[y][x].cost = INT_MAX;
-    }
-  }
+  corridor_path_init(d, path);
 
   path[from[dim_y]][from[dim_x]].cost = 0;
 
   heap_init(&h, corridor_path_cmp, NULL);
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       if (mapxy(x, y) != ter_wall_immutable) {
         path[y][x].hn = heap_insert(&h, &path[y][x]);
       } else {
@@ -212,7 +219,7 @@ static void dijkstra_corridor_inv(dungeon *d, pair_t from, pair_t to)
         }
       }
       heap_delete(&h);
-      return;
+      return path[to[dim_y]][to[dim_x]].cost;
     }
 
 #define hardnesspair_inv(p) (is_open_space(d, p[dim_y], p[dim_x]) ? 127 :     \
@@ -260,6 +267,293 @@ static void dijkstra_corridor_inv(dungeon *d, pair_t from, pair_t to)
                                            [p->pos[dim_x]    ].hn);
     }
   }
+
+  return INT_MAX;
+}
+
+const char *corridor_engine_name[num_corridor_engines] = {
+  "dijkstra",
+  "astar"
+};
+
+#ifndef VERIFY_CORRIDOR_ROUTE
+# define VERIFY_CORRIDOR_ROUTE 0
+#endif
+
+/* A* state for one cell.  Each search is numbered, and a cell's cost *
+ * and parent only count if it was last touched by the current one,  *
+ * so nothing has to be cleared between corridors.                    */
+typedef struct corridor_cell {
+  uint32_t search;
+  int32_t cost;
+  uint32_t from;
+} corridor_cell_t;
+
+typedef struct corridor_open {
+  int32_t estimate;
+  int32_t cost;
+  uint32_t cell;
+} corridor_open_t;
+
+/* The open set is a binary heap in a vector that is only ever cleared, *
+ * so after the first few corridors routing allocates nothing.  The     *
+ * heuristic is the cheapest way out of every row and column between a *
+ * cell and the target: a 4-connected path has to leave each of those  *
+ * rows with a vertical step and each of those columns with a           *
+ * horizontal one, so it never overestimates, and it drops by no more   *
+ * than a step costs, so no cell needs expanding twice.  Row and column *
+ * minimums are kept as prefix sums to make the estimate O(1).          */
+typedef struct corridor_router {
+  grid<corridor_cell_t> cell;
+  std::vector<corridor_open_t> open;
+  std::vector<int32_t> row_min, col_min, row_sum, col_sum;
+  uint32_t search;
+} corridor_router_t;
+
+static thread_local corridor_router_t router;
+
+/* The cost of leaving a cell, as charged by dijkstra_corridor() and, *
+ * with inv set, by dijkstra_corridor_inv().                          */
+static int32_t corridor_step_cost(dungeon *d, int32_t x, int32_t y, int inv)
+{
+  if (!inv) {
+    return hardnessxy(x, y);
+  }
+
+  return (is_open_space(d, y, x) ? 127 :
+          (adjacent_to_room(d, y, x) ? 191 : (255 - hardnessxy(x, y))));
+}
+
+/* Only corridors change costs, and only by carving cells, so this is  *
+ * called at the start of each batch of corridors and after each one. */
+static void corridor_router_sums(void)
+{
+  uint32_t i;
+
+  for (router.row_sum[0] = 0, i = 0; i < router.row_min.size(); i++) {
+    router.row_sum[i + 1] = router.row_sum[i] + router.row_min[i];
+  }
+  for (router.col_sum[0] = 0, i = 0; i < router.col_min.size(); i++) {
+    router.col_sum[i + 1] = router.col_sum[i] + router.col_min[i];
+  }
+}
+
+static void corridor_router_init(dungeon *d, int inv)
+{
+  int32_t x, y, cost;
+
+  if (router.cell.width() != d->width || router.cell.height() != d->height) {
+    router.cell.resize(d->width, d->height, corridor_cell_t());
+    router.search = 0;
+  }
+  router.row_min.assign(d->height, INT_MAX);
+  router.col_min.assign(d->width, INT_MAX);
+  router.row_sum.resize(d->height + 1);
+  router.col_sum.resize(d->width + 1);
+
+  for (y = 1; y < d->height - 1; y++) {
+    for (x = 1; x < d->width - 1; x++) {
+      if (mapxy(x, y) != ter_wall_immutable) {
+        cost = corridor_step_cost(d, x, y, inv);
+        if (cost < router.row_min[y]) {
+          router.row_min[y] = cost;
+        }
+        if (cost < router.col_min[x]) {
+          router.col_min[x] = cost;
+        }
+      }
+    }
+  }
+  /* The outer wall is never left, so it adds nothing. */
+  router.row_min[0] = router.row_min[d->height - 1] = 0;
+  router.col_min[0] = router.col_min[d->width - 1] = 0;
+
+  corridor_router_sums();
+}
+
+static int32_t corridor_estimate(int32_t x, int32_t y, pair_t to)
+{
+  return (((y < to[dim_y]) ?
+           router.row_sum[to[dim_y]] - router.row_sum[y] :
+           router.row_sum[y + 1] - router.row_sum[to[dim_y] + 1]) +
+          ((x < to[dim_x]) ?
+           router.col_sum[to[dim_x]] - router.col_sum[x] :
+           router.col_sum[x + 1] - router.col_sum[to[dim_x] + 1]));
+}
+
+/* Orders the open set's heap so the least estimate is on top, ties *
+ * going to the longer path, which is usually nearer the target.    */
+static bool corridor_open_after(const corridor_open_t &a,
+                                const corridor_open_t &b)
+{
+  if (a.estimate != b.estimate) {
+    return a.estimate > b.estimate;
+  }
+  if (a.cost != b.cost) {
+    return a.cost < b.cost;
+  }
+  return a.cell > b.cell;
+}
+
+/* On maps bigger than the classic 80x21, A* routes each corridor   *
+ * inside the box around its ends, grown by this much on every side. *
+ * There, every corridor starts in a network of rooms and corridors  *
+ * that spans the map and costs nothing to cross, and the window     *
+ * keeps the search near the two rooms instead of flooding the whole *
+ * network every time.  At 80x21 the window is always the whole map, *
+ * so corridors there are the cheapest overall.                      */
+#define CORRIDOR_WINDOW 20
+
+/* Sets lo and hi to the corners of the window, inclusive, and returns *
+ * whether it's the whole map.                                         */
+static int corridor_window(dungeon *d, pair_t from, pair_t to,
+                           int32_t lo[2], int32_t hi[2])
+{
+  uint32_t i;
+
+  lo[dim_x] = lo[dim_y] = 1;
+  hi[dim_x] = d->width - 2;
+  hi[dim_y] = d->height - 2;
+  if (d->width <= DUNGEON_X && d->height <= DUNGEON_Y) {
+    return 1;
+  }
+
+  for (i = 0; i < 2; i++) {
+    lo[i] = std::max(lo[i], std::min(from[i], to[i]) - CORRIDOR_WINDOW);
+    hi[i] = std::min(hi[i], std::max(from[i], to[i]) + CORRIDOR_WINDOW);
+  }
+
+  return (lo[dim_x] == 1 && lo[dim_y] == 1 &&
+          hi[dim_x] == d->width - 2 && hi[dim_y] == d->height - 2);
+}
+
+/* Routes and carves a corridor the way dijkstra_corridor() (or, with *
+ * inv set, dijkstra_corridor_inv()) does, but with A*, stopping as   *
+ * soon as the target comes off the open set.  Returns its cost.  The *
+ * corridor is the cheapest within the window, which is the cheapest  *
+ * overall whenever the window is the whole map.                      */
+static int32_t astar_corridor(dungeon *d, pair_t from, pair_t to, int inv)
+{
+  static const int32_t step[4][2] = {
+    { 0, -1 }, { -1, 0 }, { 1, 0 }, { 0, 1 }
+  };
+  corridor_cell_t *c, *n;
+  corridor_open_t o;
+  uint32_t start, target, i;
+  int32_t x, y, nx, ny, cost, lo[2], hi[2];
+
+  corridor_window(d, from, to, lo, hi);
+
+  if (!++router.search) {
+    router.cell.fill(corridor_cell_t());
+    router.search = 1;
+  }
+
+  start = from[dim_y] * d->width + from[dim_x];
+  target = to[dim_y] * d->width + to[dim_x];
+  c = router.cell.data() + start;
+  c->search = router.search;
+  c->cost = 0;
+  c->from = start;
+
+  router.open.clear();
+  o.estimate = corridor_estimate(from[dim_x], from[dim_y], to);
+  o.cost = 0;
+  o.cell = start;
+  router.open.push_back(o);
+
+  while (!router.open.empty()) {
+    std::pop_heap(router.open.begin(), router.open.end(), corridor_open_after);
+    o = router.open.back();
+    router.open.pop_back();
+
+    c = router.cell.data() + o.cell;
+    if (o.cost != c->cost) {
+      /* Superseded by a cheaper entry for the same cell. */
+      continue;
+    }
+
+    x = o.cell % d->width;
+    y = o.cell / d->width;
+
+    if (o.cell == target) {
+      for (i = target; i != start; i = router.cell.data()[i].from) {
+        x = i % d->width;
+        y = i / d->width;
+        if (mapxy(x, y) != ter_floor_room) {
+          mapxy(x, y) = ter_floor_hall;
+          hardnessxy(x, y) = 0;
+          if (!inv) {
+            router.row_min[y] = router.col_min[x] = 0;
+          }
+        }
+      }
+      if (!inv) {
+        corridor_router_sums();
+      }
+      return o.cost;
+    }
+
+    cost = o.cost + corridor_step_cost(d, x, y, inv);
+    for (i = 0; i < 4; i++) {
+      nx = x + step[i][0];
+      ny = y + step[i][1];
+      if (nx < lo[dim_x] || nx > hi[dim_x] ||
+          ny < lo[dim_y] || ny > hi[dim_y] ||
+          mapxy(nx, ny) == ter_wall_immutable) {
+        continue;
+      }
+      n = &router.cell[ny][nx];
+      if (n->search != router.search || n->cost > cost) {
+        n->search = router.search;
+        n->cost = cost;
+        n->from = o.cell;
+        o.estimate = cost + corridor_estimate(nx, ny, to);
+        o.cost = cost;
+        o.cell = ny * d->width + nx;
+        router.open.push_back(o);
+        std::push_heap(router.open.begin(), router.open.end(),
+                       corridor_open_after);
+      }
+    }
+  }
+
+  return INT_MAX;
+}
+
+/* Routes a corridor with the dungeon's corridor engine. */
+static int32_t route_corridor(dungeon *d, pair_t from, pair_t to, int inv)
+{
+#if VERIFY_CORRIDOR_ROUTE
+  grid<terrain_type> map;
+  grid<uint8_t> hardness;
+  int32_t expected, cost, lo[2], hi[2];
+#endif
+
+  if (d->corridor_engine == corridor_engine_dijkstra) {
+    return (inv ? dijkstra_corridor_inv(d, from, to) :
+                  dijkstra_corridor(d, from, to));
+  }
+
+#if VERIFY_CORRIDOR_ROUTE
+  map = d->map;
+  hardness = d->hardness;
+  expected = (inv ? dijkstra_corridor_inv(d, from, to) :
+                    dijkstra_corridor(d, from, to));
+  d->map = map;
+  d->hardness = hardness;
+  /* A windowed corridor may cost more than Dijkstra's. */
+  if ((cost = astar_corridor(d, from, to, inv)) != expected &&
+      corridor_window(d, from, to, lo, hi)) {
+    fprintf(stderr, "Corridor from (%d, %d) to (%d, %d) cost %d by A* but "
+            "%d by Dijkstra.\n", from[dim_x], from[dim_y],
+            to[dim_x], to[dim_y], cost, expected);
+    abort();
+  }
+  return cost;
+#else
+  return astar_corridor(d, from, to, inv);
+#endif
 }
 
 /* Chooses a random point inside each room and connects them with a *
@@ -269,17 +563,17 @@ static int connect_two_rooms(dungeon *d, room_t *r1, room_t *r2)
 {
   pair_t e1, e2;
 
-  e1[dim_y] = rand_range(r1->position[dim_y],
+  e1[dim_y] = d->rand.range(r1->position[dim_y],
                          r1->position[dim_y] + r1->size[dim_y] - 1);
-  e1[dim_x] = rand_range(r1->position[dim_x],
+  e1[dim_x] = d->rand.range(r1->position[dim_x],
                          r1->position[dim_x] + r1->size[dim_x] - 1);
-  e2[dim_y] = rand_range(r2->position[dim_y],
+  e2[dim_y] = d->rand.range(r2->position[dim_y],
                          r2->position[dim_y] + r2->size[dim_y] - 1);
-  e2[dim_x] = rand_range(r2->position[dim_x],
+  e2[dim_x] = d->rand.range(r2->position[dim_x],
                          r2->position[dim_x] + r2->size[dim_x] - 1);
 
   /*  return connect_two_points_recursive(d, e1, e2);*/
-  dijkstra_corridor(d, e1, e2);
+  route_corridor(d, e1, e2, 0);
 
   return 0;
 }
@@ -292,6 +586,10 @@ static int create_cycle(dungeon *d)
   uint32_t max, tmp, i, j, p, q;
   pair_t e1, e2;
 
+  if (d->num_rooms < 2) {
+    return 0;
+  }
+
   for (i = max = 0; i < d->num_rooms - 1; i++) {
     for (j = i + 1; j < d->num_rooms; j++) {
       tmp = (((d->rooms[i].position[dim_x] - d->rooms[j].position[dim_x])  *
@@ -308,20 +606,23 @@ static int create_cycle(dungeon *d)
 
   /* Can't simply call connect_two_rooms() because it doesn't *
    * use inverse hardnesses, so duplicate it here.            */
-  e1[dim_y] = rand_range(d->rooms[p].position[dim_y],
+  e1[dim_y] = d->rand.range(d->rooms[p].position[dim_y],
                          (d->rooms[p].position[dim_y] +
                           d->rooms[p].size[dim_y] - 1));
-  e1[dim_x] = rand_range(d->rooms[p].position[dim_x],
+  e1[dim_x] = d->rand.range(d->rooms[p].position[dim_x],
                          (d->rooms[p].position[dim_x] +
                           d->rooms[p].size[dim_x] - 1));
-  e2[dim_y] = rand_range(d->rooms[q].position[dim_y],
+  e2[dim_y] = d->rand.range(d->rooms[q].position[dim_y],
                          (d->rooms[q].position[dim_y] +
                           d->rooms[q].size[dim_y] - 1));
-  e2[dim_x] = rand_range(d->rooms[q].position[dim_x],
+  e2[dim_x] = d->rand.range(d->rooms[q].position[dim_x],
                          (d->rooms[q].position[dim_x] +
                           d->rooms[q].size[dim_x] - 1));
 
-  dijkstra_corridor_inv(d, e1, e2);
+  if (d->corridor_engine == corridor_engine_astar) {
+    corridor_router_init(d, 1);
+  }
+  route_corridor(d, e1, e2, 1);
 
   return 0;
 }
@@ -330,6 +631,9 @@ static int connect_rooms(dungeon *d)
 {
   uint32_t i;
 
+  if (d->corridor_engine == corridor_engine_astar) {
+    corridor_router_init(d, 0);
+  }
   for (i = 1; i < d->num_rooms; i++) {
     connect_two_rooms(d, d->rooms + i - 1, d->rooms + i);
   }
@@ -352,7 +656,7 @@ typedef struct queue_node {
   struct queue_node *next;
 } queue_node_t;
 
-static int smooth_hardness(dungeon *d)
+static int smooth_hardness_list(dungeon *d)
 {
   int32_t i, x, y;
   int32_t s, t, p, q;
@@ -360,15 +664,16 @@ static int smooth_hardness(dungeon *d)
 #if DUMP_HARDNESS_IMAGES
   FILE *out;
 #endif
-  uint8_t hardness[DUNGEON_Y][DUNGEON_X];
+  int32_t width = d->width, height = d->height;
+  grid<uint8_t> hardness;
 
-  memset(&hardness, 0, sizeof (hardness));
+  hardness.resize(width, height, 0);
 
   /* Seed with some values */
   for (i = 1; i < 255; i += 20) {
     do {
-      x = rand() % DUNGEON_X;
-      y = rand() % DUNGEON_Y;
+      x = d->rand.next() % width;
+      y = d->rand.next() % height;
     } while (hardness[y][x]);
     hardness[y][x] = i;
     if (i == 1) {
@@ -384,8 +689,8 @@ static int smooth_hardness(dungeon *d)
 
 #if DUMP_HARDNESS_IMAGES
   out = fopen("seeded.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", DUNGEON_X, DUNGEON_Y);
-  fwrite(&hardness, sizeof (hardness), 1, out);
+  fprintf(out, "P5\n%u %u\n255\n", width, height);
+  fwrite(hardness.data(), hardness.size(), 1, out);
   fclose(out);
 #endif
   
@@ -411,7 +716,7 @@ static int smooth_hardness(dungeon *d)
       tail->x = x - 1;
       tail->y = y;
     }
-    if (x - 1 >= 0 && y + 1 < DUNGEON_Y && !hardness[y + 1][x - 1]) {
+    if (x - 1 >= 0 && y + 1 < height && !hardness[y + 1][x - 1]) {
       hardness[y + 1][x - 1] = i;
       tail->next = (queue_node_t *) malloc(sizeof (*tail));
       tail = tail->next;
@@ -427,7 +732,7 @@ static int smooth_hardness(dungeon *d)
       tail->x = x;
       tail->y = y - 1;
     }
-    if (y + 1 < DUNGEON_Y && !hardness[y + 1][x]) {
+    if (y + 1 < height && !hardness[y + 1][x]) {
       hardness[y + 1][x] = i;
       tail->next = (queue_node_t *) malloc(sizeof (*tail));
       tail = tail->next;
@@ -435,7 +740,7 @@ static int smooth_hardness(dungeon *d)
       tail->x = x;
       tail->y = y + 1;
     }
-    if (x + 1 < DUNGEON_X && y - 1 >= 0 && !hardness[y - 1][x + 1]) {
+    if (x + 1 < width && y - 1 >= 0 && !hardness[y - 1][x + 1]) {
       hardness[y - 1][x + 1] = i;
       tail->next = (queue_node_t *) malloc(sizeof (*tail));
       tail = tail->next;
@@ -443,7 +748,7 @@ static int smooth_hardness(dungeon *d)
       tail->x = x + 1;
       tail->y = y - 1;
     }
-    if (x + 1 < DUNGEON_X && !hardness[y][x + 1]) {
+    if (x + 1 < width && !hardness[y][x + 1]) {
       hardness[y][x + 1] = i;
       tail->next = (queue_node_t *) malloc(sizeof (*tail));
       tail = tail->next;
@@ -451,7 +756,7 @@ static int smooth_hardness(dungeon *d)
       tail->x = x + 1;
       tail->y = y;
     }
-    if (x + 1 < DUNGEON_X && y + 1 < DUNGEON_Y && !hardness[y + 1][x + 1]) {
+    if (x + 1 < width && y + 1 < height && !hardness[y + 1][x + 1]) {
       hardness[y + 1][x + 1] = i;
       tail->next = (queue_node_t *) malloc(sizeof (*tail));
       tail = tail->next;
@@ -466,12 +771,12 @@ static int smooth_hardness(dungeon *d)
   }
 
   /* And smooth it a bit with a gaussian convolution */
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
       for (s = t = p = 0; p < 5; p++) {
         for (q = 0; q < 5; q++) {
-          if (y + (p - 2) >= 0 && y + (p - 2) < DUNGEON_Y &&
-              x + (q - 2) >= 0 && x + (q - 2) < DUNGEON_X) {
+          if (y + (p - 2) >= 0 && y + (p - 2) < height &&
+              x + (q - 2) >= 0 && x + (q - 2) < width) {
             s += gaussian[p][q];
             t += hardness[y + (p - 2)][x + (q - 2)] * gaussian[p][q];
           }
@@ -481,12 +786,12 @@ static int smooth_hardness(dungeon *d)
     }
   }
   /* Let's do it again, until it's smooth like Kenny G. */
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
       for (s = t = p = 0; p < 5; p++) {
         for (q = 0; q < 5; q++) {
-          if (y + (p - 2) >= 0 && y + (p - 2) < DUNGEON_Y &&
-              x + (q - 2) >= 0 && x + (q - 2) < DUNGEON_X) {
+          if (y + (p - 2) >= 0 && y + (p - 2) < height &&
+              x + (q - 2) >= 0 && x + (q - 2) < width) {
             s += gaussian[p][q];
             t += hardness[y + (p - 2)][x + (q - 2)] * gaussian[p][q];
           }
@@ -498,29 +803,175 @@ static int smooth_hardness(dungeon *d)
 
 #if DUMP_HARDNESS_IMAGES
   out = fopen("diffused.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", DUNGEON_X, DUNGEON_Y);
-  fwrite(&hardness, sizeof (hardness), 1, out);
+  fprintf(out, "P5\n%u %u\n255\n", width, height);
+  fwrite(hardness.data(), hardness.size(), 1, out);
   fclose(out);
 
   out = fopen("smoothed.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", DUNGEON_X, DUNGEON_Y);
-  fwrite(&d->hardness, sizeof (d->hardness), 1, out);
+  fprintf(out, "P5\n%u %u\n255\n", width, height);
+  fwrite(d->hardness.data(), d->hardness.size(), 1, out);
   fclose(out);
 #endif
 
   return 0;
 }
 
+const char *hardness_engine_name[num_hardness_engines] = {
+  "list",
+  "array"
+};
+
+/* The array engine's working space, kept between calls. */
+typedef struct hardness_scratch {
+  grid<uint8_t> padded;
+  grid<int32_t> row;
+  std::vector<uint32_t> queue;
+  std::vector<int32_t> sum;
+} hardness_scratch_t;
+
+static thread_local hardness_scratch_t scratch;
+
+/* Builds exactly the map smooth_hardness_list() does, without allocating *
+ * once the scratch space has grown to fit.  The flood runs in a copy     *
+ * with two cells of padding on every side.  The padding is nonzero for   *
+ * the flood, which stops it without bounds checks, then zero for the     *
+ * filter, where it adds nothing, as the taps the list engine skips off   *
+ * the edge add nothing.  Every cell is queued exactly once, in the same  *
+ * order as the list engine queues them, so the queue is a flat array.    *
+ *                                                                        *
+ * The Gaussian isn't quite separable: it is the outer product of         *
+ * 1 4 7 4 1 with itself, less 8 at the center and 2 at each of the       *
+ * center's four neighbors.  So it's a horizontal pass and a vertical     *
+ * pass, less that correction, divided by the weight of the taps that     *
+ * are on the map, which depends only on how near an edge the cell is.    *
+ * The list engine's second pass reads and writes exactly what its first  *
+ * does, so it isn't repeated.                                            */
+static int smooth_hardness_array(dungeon *d)
+{
+  int32_t width = d->width, height = d->height, pw = width + 4;
+  int32_t offset[8] = {
+    -pw - 1, -1, pw - 1, -pw, pw, -pw + 1, 1, pw + 1
+  };
+  int32_t edge_y[5] = { 0, 1, 2, height - 2, height - 1 };
+  int32_t edge_x[5] = { 0, 1, 2, width - 2, width - 1 };
+  int32_t weight[5][5];
+  int32_t i, j, x, y, p, q, yc;
+  uint32_t head, tail, c, n;
+  int32_t *r, *t;
+  uint8_t *h, *m;
+
+  scratch.padded.resize(pw, height + 4, 0);
+  scratch.row.resize(width, height + 4, 0);
+  scratch.queue.resize(width * height);
+  scratch.sum.resize(width);
+  h = scratch.padded.data();
+
+  for (x = 0; x < pw; x++) {
+    scratch.padded[0][x] = scratch.padded[1][x] = 1;
+    scratch.padded[height + 2][x] = scratch.padded[height + 3][x] = 1;
+  }
+  for (y = 2; y < height + 2; y++) {
+    scratch.padded[y][0] = scratch.padded[y][1] = 1;
+    scratch.padded[y][pw - 2] = scratch.padded[y][pw - 1] = 1;
+  }
+
+  /* Seed with some values, drawing exactly what the list engine draws. */
+  for (tail = 0, i = 1; i < 255; i += 20) {
+    do {
+      x = d->rand.next() % width;
+      y = d->rand.next() % height;
+    } while (scratch.padded[y + 2][x + 2]);
+    scratch.padded[y + 2][x + 2] = i;
+    scratch.queue[tail++] = (y + 2) * pw + x + 2;
+  }
+
+  for (head = 0; head < tail; head++) {
+    c = scratch.queue[head];
+    for (j = 0; j < 8; j++) {
+      n = c + offset[j];
+      if (!h[n]) {
+        h[n] = h[c];
+        scratch.queue[tail++] = n;
+      }
+    }
+  }
+
+  for (x = 0; x < pw; x++) {
+    scratch.padded[0][x] = scratch.padded[1][x] = 0;
+    scratch.padded[height + 2][x] = scratch.padded[height + 3][x] = 0;
+  }
+  for (y = 2; y < height + 2; y++) {
+    scratch.padded[y][0] = scratch.padded[y][1] = 0;
+    scratch.padded[y][pw - 2] = scratch.padded[y][pw - 1] = 0;
+  }
+
+  /* The weight of the on-map taps for cells 0, 1, 2 or more, 2 and 1 *
+   * from the top (or left) edge, and 1 from the bottom (or right).   */
+  for (i = 0; i < 5; i++) {
+    for (j = 0; j < 5; j++) {
+      for (weight[i][j] = p = 0; p < 5; p++) {
+        for (q = 0; q < 5; q++) {
+          if (edge_y[i] + (p - 2) >= 0 && edge_y[i] + (p - 2) < height &&
+              edge_x[j] + (q - 2) >= 0 && edge_x[j] + (q - 2) < width) {
+            weight[i][j] += gaussian[p][q];
+          }
+        }
+      }
+    }
+  }
+
+  for (y = 0; y < height + 4; y++) {
+    m = scratch.padded[y];
+    r = scratch.row[y];
+    for (x = 0; x < width; x++) {
+      r[x] = m[x] + 4 * m[x + 1] + 7 * m[x + 2] + 4 * m[x + 3] + m[x + 4];
+    }
+  }
+
+  t = scratch.sum.data();
+  for (y = 0; y < height; y++) {
+    m = scratch.padded[y + 2] + 2;
+    for (x = 0; x < width; x++) {
+      t[x] = (scratch.row[y][x] + 4 * scratch.row[y + 1][x] +
+              7 * scratch.row[y + 2][x] + 4 * scratch.row[y + 3][x] +
+              scratch.row[y + 4][x] -
+              8 * m[x] - 2 * (m[x - pw] + m[x - 1] + m[x + 1] + m[x + pw]));
+    }
+
+    yc = (y < 2) ? y : ((y >= height - 2) ? y - height + 5 : 2);
+    for (x = 0; x < 2; x++) {
+      d->hardness[y][x] = t[x] / weight[yc][x];
+    }
+    for (; x < width - 2; x++) {
+      d->hardness[y][x] = t[x] / weight[yc][2];
+    }
+    for (; x < width; x++) {
+      d->hardness[y][x] = t[x] / weight[yc][x - width + 5];
+    }
+  }
+
+  return 0;
+}
+
+void smooth_hardness(dungeon *d)
+{
+  if (d->hardness_engine == hardness_engine_list) {
+    smooth_hardness_list(d);
+  } else {
+    smooth_hardness_array(d);
+  }
+}
+
 static int empty_dungeon(dungeon *d)
 {
-  uint8_t x, y;
+  uint32_t x, y;
 
   smooth_hardness(d);
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       mapxy(x, y) = ter_wall;
-      if (y == 0 || y == DUNGEON_Y - 1 ||
-          x == 0 || x == DUNGEON_X - 1) {
+      if (y == 0 || y == d->height - 1U ||
+          x == 0 || x == d->width - 1U) {
         mapxy(x, y) = ter_wall_immutable;
         hardnessxy(x, y) = 255;
       }
@@ -532,7 +983,7 @@ static int empty_dungeon(dungeon *d)
   return 0;
 }
 
-static int place_rooms(dungeon *d)
+static int place_rooms_restart(dungeon *d)
 {
   pair_t p;
   uint32_t i;
@@ -543,8 +994,8 @@ static int place_rooms(dungeon *d)
     success = 1;
     for (i = 0; success && i < d->num_rooms; i++) {
       r = d->rooms + i;
-      r->position[dim_x] = 1 + rand() % (DUNGEON_X - 2 - r->size[dim_x]);
-      r->position[dim_y] = 1 + rand() % (DUNGEON_Y - 2 - r->size[dim_y]);
+      r->position[dim_x] = 1 + d->rand.next() % (d->width - 2 - r->size[dim_x]);
+      r->position[dim_y] = 1 + d->rand.next() % (d->height - 2 - r->size[dim_y]);
       for (p[dim_y] = r->position[dim_y] - 1;
            success && p[dim_y] < r->position[dim_y] + r->size[dim_y] + 1;
            p[dim_y]++) {
@@ -569,44 +1020,173 @@ static int place_rooms(dungeon *d)
   return 0;
 }
 
+const char *room_engine_name[num_room_engines] = {
+  "restart",
+  "bitmap"
+};
+
+/* Draws the bitmap engine makes for a room before doing without it. */
+#define ROOM_PLACEMENT_TRIES 1000
+/* The bitmap engine connects rooms in a boustrophedon through bands *
+ * of map this tall.                                                 */
+#define ROOM_ORDER_BAND      (ROOM_MAX_Y + 1)
+
+/* A bit per cell, set for room floor, with each map row starting on a *
+ * fresh 64-bit word.  Kept between calls.                             */
+static thread_local std::vector<uint64_t> occupied;
+
+/* Whether any of columns x0 through x1 is set in the bitmap row. */
+static int row_occupied(const uint64_t *row, uint32_t x0, uint32_t x1)
+{
+  uint64_t first = ~0ULL << (x0 % 64), last = ~0ULL >> (63 - x1 % 64);
+  uint32_t i;
+
+  if (x0 / 64 == x1 / 64) {
+    return !!(row[x0 / 64] & first & last);
+  }
+  if (row[x0 / 64] & first) {
+    return 1;
+  }
+  for (i = x0 / 64 + 1; i < x1 / 64; i++) {
+    if (row[i]) {
+      return 1;
+    }
+  }
+  return !!(row[x1 / 64] & last);
+}
+
+static void row_occupy(uint64_t *row, uint32_t x0, uint32_t x1)
+{
+  uint64_t first = ~0ULL << (x0 % 64), last = ~0ULL >> (63 - x1 % 64);
+  uint32_t i;
+
+  if (x0 / 64 == x1 / 64) {
+    row[x0 / 64] |= first & last;
+    return;
+  }
+  row[x0 / 64] |= first;
+  for (i = x0 / 64 + 1; i < x1 / 64; i++) {
+    row[i] = ~0ULL;
+  }
+  row[x1 / 64] |= last;
+}
+
+static bool room_before(const room_t &a, const room_t &b)
+{
+  int32_t band_a = a.position[dim_y] / ROOM_ORDER_BAND;
+  int32_t band_b = b.position[dim_y] / ROOM_ORDER_BAND;
+
+  if (band_a != band_b) {
+    return band_a < band_b;
+  }
+  if (a.position[dim_x] != b.position[dim_x]) {
+    return ((band_a & 1) ? a.position[dim_x] > b.position[dim_x] :
+                           a.position[dim_x] < b.position[dim_x]);
+  }
+  return a.position[dim_y] < b.position[dim_y];
+}
+
+/* Tests a candidate against the bitmap, one or two words per row, so *
+ * a draw costs the same however many rooms are already down.  Rooms  *
+ * keep a cell of rock between them, as with the restart engine.      */
+static int place_rooms_bitmap(dungeon *d)
+{
+  uint32_t stride = (d->width + 63) / 64;
+  uint32_t i, tries, x, y;
+  room_t *r;
+
+  occupied.assign(stride * d->height, 0);
+
+  for (i = 0; i < d->num_rooms; ) {
+    r = d->rooms + i;
+    for (tries = 0; tries < ROOM_PLACEMENT_TRIES; tries++) {
+      r->position[dim_x] = 1 + d->rand.next() % (d->width - 2 - r->size[dim_x]);
+      r->position[dim_y] = 1 + d->rand.next() % (d->height - 2 - r->size[dim_y]);
+      for (y = r->position[dim_y] - 1;
+           (y <= (uint32_t) r->position[dim_y] + r->size[dim_y] &&
+            !row_occupied(&occupied[y * stride], r->position[dim_x] - 1,
+                          r->position[dim_x] + r->size[dim_x]));
+           y++)
+        ;
+      if (y > (uint32_t) r->position[dim_y] + r->size[dim_y]) {
+        break;
+      }
+    }
+
+    if (tries == ROOM_PLACEMENT_TRIES) {
+      /* No room for this one.  Try the last in its place. */
+      d->rooms[i] = d->rooms[--d->num_rooms];
+      continue;
+    }
+
+    for (y = r->position[dim_y];
+         y < (uint32_t) r->position[dim_y] + r->size[dim_y];
+         y++) {
+      row_occupy(&occupied[y * stride], r->position[dim_x],
+                 r->position[dim_x] + r->size[dim_x] - 1);
+      for (x = r->position[dim_x];
+           x < (uint32_t) r->position[dim_x] + r->size[dim_x];
+           x++) {
+        mapxy(x, y) = ter_floor_room;
+        hardnessxy(x, y) = 0;
+      }
+    }
+    i++;
+  }
+
+  std::sort(d->rooms, d->rooms + d->num_rooms, room_before);
+
+  return 0;
+}
+
+static int place_rooms(dungeon *d)
+{
+  if (d->room_engine == room_engine_restart) {
+    return place_rooms_restart(d);
+  }
+
+  return place_rooms_bitmap(d);
+}
+
 static void place_stairs(dungeon *d)
 {
   pair_t p;
   do {
-    while ((p[dim_y] = rand_range(1, DUNGEON_Y - 2)) &&
-           (p[dim_x] = rand_range(1, DUNGEON_X - 2)) &&
+    while ((p[dim_y] = d->rand.range(1, d->height - 2)) &&
+           (p[dim_x] = d->rand.range(1, d->width - 2)) &&
            ((mappair(p) < ter_floor)                 ||
             (mappair(p) > ter_stairs)))
       ;
     mappair(p) = ter_stairs_down;
-  } while (rand_under(1, 3));
+  } while (d->rand.under(1, 3));
   do {
-    while ((p[dim_y] = rand_range(1, DUNGEON_Y - 2)) &&
-           (p[dim_x] = rand_range(1, DUNGEON_X - 2)) &&
+    while ((p[dim_y] = d->rand.range(1, d->height - 2)) &&
+           (p[dim_x] = d->rand.range(1, d->width - 2)) &&
            ((mappair(p) < ter_floor)                 ||
             (mappair(p) > ter_stairs)))
       
       ;
     mappair(p) = ter_stairs_up;
-  } while (rand_under(2, 4));
+  } while (d->rand.under(2, 4));
 }
 
 static int make_rooms(dungeon *d)
 {
   uint32_t i;
 
-  for (i = MIN_ROOMS; i < MAX_ROOMS && rand_under(5, 8); i++)
+  for (i = MIN_ROOMS; i < MAX_ROOMS && d->rand.under(5, 8); i++)
     ;
-  d->num_rooms = i;
+  d->num_rooms = ((uint64_t) i * d->width * d->height /
+                  (DUNGEON_X * DUNGEON_Y));
   d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
   
   for (i = 0; i < d->num_rooms; i++) {
     d->rooms[i].size[dim_x] = ROOM_MIN_X;
     d->rooms[i].size[dim_y] = ROOM_MIN_Y;
-    while (rand_under(3, 5) && d->rooms[i].size[dim_x] < ROOM_MAX_X) {
+    while (d->rand.under(3, 5) && d->rooms[i].size[dim_x] < ROOM_MAX_X) {
       d->rooms[i].size[dim_x]++;
     }
-    while (rand_under(3, 5) && d->rooms[i].size[dim_y] < ROOM_MAX_Y) {
+    while (d->rand.under(3, 5) && d->rooms[i].size[dim_y] < ROOM_MAX_Y) {
       d->rooms[i].size[dim_y]++;
     }
   }
@@ -632,8 +1212,8 @@ void render_dungeon(dungeon *d)
   pair_t p;
 
   putchar('\n');
-  for (p[dim_y] = 0; p[dim_y] < DUNGEON_Y; p[dim_y]++) {
-    for (p[dim_x] = 0; p[dim_x] < DUNGEON_X; p[dim_x]++) {
+  for (p[dim_y] = 0; p[dim_y] < d->height; p[dim_y]++) {
+    for (p[dim_x] = 0; p[dim_x] < d->width; p[dim_x]++) {
       if (charpair(p)) {
         putchar(charpair(p)->symbol);
       } else {
@@ -672,54 +1252,164 @@ void render_dungeon(dungeon *d)
 
 void delete_dungeon(dungeon *d)
 {
+  event *e;
+
   free(d->rooms);
-  heap_delete(&d->events);
-  memset(d->character_map, 0, sizeof (d->character_map));
+  while ((e = eventq_remove_min(&d->events))) {
+    event_delete(d, e);
+  }
+  eventq_delete(&d->events);
+  d->character_map.fill(NULL);
   destroy_objects(d);
 }
 
+/* (Re)allocates every map at the dungeon's current dimensions. */
+static void size_dungeon(dungeon *d)
+{
+  d->map.resize(d->width, d->height, ter_wall);
+  d->hardness.resize(d->width, d->height, 0);
+  d->pc_distance.resize(d->width, d->height, DISTANCE_INFINITY);
+  d->pc_tunnel.resize(d->width, d->height, DISTANCE_INFINITY);
+  d->character_map.resize(d->width, d->height, NULL);
+  d->objmap.resize(d->width, d->height, NULL);
+  d->pc_distance_dirty = d->pc_tunnel_dirty = 1;
+}
+
 void init_dungeon(dungeon *d)
 {
+  size_dungeon(d);
   empty_dungeon(d);
-  memset(&d->events, 0, sizeof (d->events));
-  heap_init(&d->events, compare_events, event_delete);
-  memset(d->character_map, 0, sizeof (d->character_map));
-  memset(d->objmap, 0, sizeof (d->objmap));
+  eventq_init(&d->events, d->event_engine);
 }
 
-int write_dungeon_map(dungeon *d, FILE *f)
+const char *save_encoding_name[num_save_encodings] = {
+  "raw",
+  "rle"
+};
+
+/* The semantic, version, size, width and height. */
+#define DUNGEON_SAVE_HEADER_SIZED 24
+
+/* The version a dungeon is saved as without compression; see *
+ * DUNGEON_SAVE_VERSION_SIZED.                                */
+static uint32_t raw_save_version(dungeon *d)
 {
-  uint32_t x, y;
+  return ((d->width == DUNGEON_X && d->height == DUNGEON_Y) ?
+          DUNGEON_SAVE_VERSION : DUNGEON_SAVE_VERSION_SIZED);
+}
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      fwrite(&d->hardness[y][x], sizeof (unsigned char), 1, f);
-    }
+int save_compressed(dungeon *d)
+{
+  return (d->save_encoding == save_encoding_rle &&
+          (d->width != DUNGEON_X || d->height != DUNGEON_Y));
+}
+
+/* The version a dungeon is saved as; see DUNGEON_SAVE_COMPRESSED. */
+static uint32_t save_version(dungeon *d)
+{
+  if (save_compressed(d)) {
+    return DUNGEON_SAVE_VERSION_SIZED | DUNGEON_SAVE_COMPRESSED;
   }
 
-  return 0;
+  return raw_save_version(d);
 }
 
-int write_rooms(dungeon *d, FILE *f)
+/* Saves are built in memory and written with a single write().  Loads *
+ * map the file and decode straight out of the mapping, with a cursor  *
+ * that checks every read against the end of the file, so that a bad   *
+ * count can't run off it.                                             */
+typedef struct save_cursor {
+  const uint8_t *p;
+  const uint8_t *end;
+} save_cursor_t;
+
+static const uint8_t *take(save_cursor_t *c, size_t n)
+{
+  const uint8_t *p;
+
+  if ((size_t) (c->end - c->p) < n) {
+    fprintf(stderr, "Truncated save file.\n");
+    exit(-1);
+  }
+  p = c->p;
+  c->p += n;
+
+  return p;
+}
+
+static uint16_t take_be16(save_cursor_t *c)
+{
+  uint16_t be16;
+
+  memcpy(&be16, take(c, sizeof (be16)), sizeof (be16));
+
+  return be16toh(be16);
+}
+
+static uint32_t take_be32(save_cursor_t *c)
+{
+  uint32_t be32;
+
+  memcpy(&be32, take(c, sizeof (be32)), sizeof (be32));
+
+  return be32toh(be32);
+}
+
+/* Coordinates are single bytes in version 0 files and big-endian 16-bit *
+ * values in the others.                                                 */
+static uint32_t take_coord(save_cursor_t *c, uint32_t version)
+{
+  return version == DUNGEON_SAVE_VERSION ? *take(c, 1) : take_be16(c);
+}
+
+static uint8_t *put_be16(uint8_t *p, uint16_t v)
+{
+  v = htobe16(v);
+  memcpy(p, &v, sizeof (v));
+
+  return p + sizeof (v);
+}
+
+static uint8_t *put_be32(uint8_t *p, uint32_t v)
+{
+  v = htobe32(v);
+  memcpy(p, &v, sizeof (v));
+
+  return p + sizeof (v);
+}
+
+static uint8_t *put_coord(uint8_t *p, uint32_t c, uint32_t version)
+{
+  if (version == DUNGEON_SAVE_VERSION) {
+    *p = c;
+    return p + 1;
+  }
+
+  return put_be16(p, c);
+}
+
+static uint8_t *put_dungeon_map(dungeon *d, uint8_t *p)
+{
+  /* The grid is already in row order, just as the file wants it. */
+  memcpy(p, d->hardness.data(), d->hardness.size());
+
+  return p + d->hardness.size();
+}
+
+static uint8_t *put_rooms(dungeon *d, uint8_t *p, uint32_t version)
 {
   uint32_t i;
-  uint16_t p;
 
-  p = htobe16(d->num_rooms);
-  fwrite(&p, 2, 1, f);
+  p = put_be16(p, d->num_rooms);
   for (i = 0; i < d->num_rooms; i++) {
     /* write order is xpos, ypos, width, height */
-    p = d->rooms[i].position[dim_x];
-    fwrite(&p, 1, 1, f);
-    p = d->rooms[i].position[dim_y];
-    fwrite(&p, 1, 1, f);
-    p = d->rooms[i].size[dim_x];
-    fwrite(&p, 1, 1, f);
-    p = d->rooms[i].size[dim_y];
-    fwrite(&p, 1, 1, f);
+    p = put_coord(p, d->rooms[i].position[dim_x], version);
+    p = put_coord(p, d->rooms[i].position[dim_y], version);
+    p = put_coord(p, d->rooms[i].size[dim_x], version);
+    p = put_coord(p, d->rooms[i].size[dim_y], version);
   }
 
-  return 0;
+  return p;
 }
 
 uint16_t count_up_stairs(dungeon *d)
@@ -727,8 +1417,8 @@ uint16_t count_up_stairs(dungeon *d)
   uint32_t x, y;
   uint16_t i;
 
-  for (i = 0, y = 1; y < DUNGEON_Y - 1; y++) {
-    for (x = 1; x < DUNGEON_X - 1; x++) {
+  for (i = 0, y = 1; y < d->height - 1U; y++) {
+    for (x = 1; x < d->width - 1U; x++) {
       if (mapxy(x, y) == ter_stairs_up) {
         i++;
       }
@@ -743,8 +1433,8 @@ uint16_t count_down_stairs(dungeon *d)
   uint32_t x, y;
   uint16_t i;
 
-  for (i = 0, y = 1; y < DUNGEON_Y - 1; y++) {
-    for (x = 1; x < DUNGEON_X - 1; x++) {
+  for (i = 0, y = 1; y < d->height - 1U; y++) {
+    for (x = 1; x < d->width - 1U; x++) {
       if (mapxy(x, y) == ter_stairs_down) {
         i++;
       }
@@ -754,198 +1444,354 @@ uint16_t count_down_stairs(dungeon *d)
   return i;
 }
 
-int write_stairs(dungeon *d, FILE *f)
+static uint8_t *put_stairs(dungeon *d, uint8_t *p, uint32_t version)
 {
   uint16_t num_stairs;
-  uint8_t x, y;
+  uint32_t x, y;
 
-  num_stairs = htobe16(count_up_stairs(d));
-  fwrite(&num_stairs, 2, 1, f);
-  for (y = 1; y < DUNGEON_Y - 1 && num_stairs; y++) {
-    for (x = 1; x < DUNGEON_X - 1 && num_stairs; x++) {
+  num_stairs = count_up_stairs(d);
+  p = put_be16(p, num_stairs);
+  for (y = 1; y < d->height - 1U && num_stairs; y++) {
+    for (x = 1; x < d->width - 1U && num_stairs; x++) {
       if (mapxy(x, y) == ter_stairs_up) {
         num_stairs--;
-        fwrite(&x, 1, 1, f);
-        fwrite(&y, 1, 1, f);
+        p = put_coord(p, x, version);
+        p = put_coord(p, y, version);
       }
     }
   }
 
-  num_stairs = htobe16(count_down_stairs(d));
-  fwrite(&num_stairs, 2, 1, f);
-  for (y = 1; y < DUNGEON_Y - 1 && num_stairs; y++) {
-    for (x = 1; x < DUNGEON_X - 1 && num_stairs; x++) {
+  num_stairs = count_down_stairs(d);
+  p = put_be16(p, num_stairs);
+  for (y = 1; y < d->height - 1U && num_stairs; y++) {
+    for (x = 1; x < d->width - 1U && num_stairs; x++) {
       if (mapxy(x, y) == ter_stairs_down) {
         num_stairs--;
-        fwrite(&x, 1, 1, f);
-        fwrite(&y, 1, 1, f);
+        p = put_coord(p, x, version);
+        p = put_coord(p, y, version);
       }
     }
   }
 
-  return 0;
+  return p;
 }
 
-uint32_t calculate_dungeon_size(dungeon *d)
+/* The size of a dungeon saved as version, with the hardness raw. */
+uint32_t calculate_dungeon_size(dungeon *d, uint32_t version)
 {
-  /* Per the spec, 1708 is 12 byte semantic marker + 4 byte file verion + *
-   * 4 byte file size + 2 byte PC position + 1680 byte hardness array +   *
-   * 2 byte each number of rooms, number of up stairs, number of down     *
-   * stairs.                                                              */
-  return (1708 + (d->num_rooms * 4) +
-          (count_up_stairs(d) * 2)  +
-          (count_down_stairs(d) * 2));
+  if (version == DUNGEON_SAVE_VERSION) {
+    /* Per the spec, 1708 is 12 byte semantic marker + 4 byte file verion + *
+     * 4 byte file size + 2 byte PC position + 1680 byte hardness array +   *
+     * 2 byte each number of rooms, number of up stairs, number of down     *
+     * stairs.                                                              */
+    return (1708 + (d->num_rooms * 4) +
+            (count_up_stairs(d) * 2)  +
+            (count_down_stairs(d) * 2));
+  }
+
+  /* The same, but with 2 bytes each of width and height after the file *
+   * size, and every coordinate twice as wide.                          */
+  return (34 + (d->width * d->height) +
+          (d->num_rooms * 8)          +
+          (count_up_stairs(d) * 4)    +
+          (count_down_stairs(d) * 4));
 }
 
-int write_dungeon(dungeon *d, char *file)
+/* Opens file, or when that's NULL, the default save file under $HOME, *
+ * creating its directory when writing.  Failing to open a file named  *
+ * on the command line is fatal; failing on the default returns -1.    */
+static int open_save_file(char *file, int flags)
 {
   const char *home;
   char *filename;
-  FILE *f;
   size_t len;
-  uint32_t be32;
+  int fd;
 
-  if (!file) {
-    if (!(home = getenv("HOME"))) {
-      fprintf(stderr, "\"HOME\" is undefined.  Using working directory.\n");
-      home = ".";
+  if (file) {
+    if ((fd = open(file, flags, 0666)) < 0) {
+      perror(file);
+      exit(-1);
     }
 
-    len = (strlen(home) + strlen(SAVE_DIR) + strlen(DUNGEON_SAVE_FILE) +
-           1 /* The NULL terminator */                                 +
-           2 /* The slashes */);
+    return fd;
+  }
 
-    filename = (char *) malloc(len * sizeof (*filename));
-    sprintf(filename, "%s/%s/", home, SAVE_DIR);
+  if (!(home = getenv("HOME"))) {
+    fprintf(stderr, "\"HOME\" is undefined.  Using working directory.\n");
+    home = ".";
+  }
+
+  len = (strlen(home) + strlen(SAVE_DIR) + strlen(DUNGEON_SAVE_FILE) +
+         1 /* The NULL terminator */                                 +
+         2 /* The slashes */);
+
+  filename = (char *) malloc(len * sizeof (*filename));
+  sprintf(filename, "%s/%s/", home, SAVE_DIR);
+  if (flags & O_CREAT) {
     makedirectory(filename);
-    strcat(filename, DUNGEON_SAVE_FILE);
+  }
+  strcat(filename, DUNGEON_SAVE_FILE);
 
-    if (!(f = fopen(filename, "w"))) {
-      perror(filename);
-      free(filename);
+  if ((fd = open(filename, flags, 0666)) < 0) {
+    perror(filename);
+  }
+  free(filename);
 
+  return fd;
+}
+
+/* Writes the finished image in one go.  write() only comes up short on *
+ * full disks and the like, but it's allowed to, so keep at it.         */
+static int write_save_file(char *file, const std::vector<uint8_t> &image)
+{
+  const uint8_t *p;
+  pack_writer_t w;
+  std::string path;
+  int64_t level;
+  ssize_t n;
+  int fd;
+
+  /* Saving into a pack adds a level to it. */
+  if (file && pack_name(file, &path, &level)) {
+    if (level >= 0) {
+      fprintf(stderr, "Can't save over level %ld of %s.\n",
+              level, path.c_str());
       return 1;
     }
-    free(filename);
-  } else {
-    if (!(f = fopen(file, "w"))) {
-      perror(file);
-      exit(-1);
+    if (pack_writer_open(&w, path.c_str())) {
+      return 1;
+    }
+    if (pack_append(&w, image.data(), image.size())) {
+      pack_writer_close(&w);
+      return 1;
     }
+
+    return pack_writer_close(&w);
+  }
+
+  if ((fd = open_save_file(file, O_WRONLY | O_CREAT | O_TRUNC)) < 0) {
+    return 1;
   }
 
+  for (p = image.data(); p < image.data() + image.size(); p += n) {
+    if ((n = write(fd, p, image.data() + image.size() - p)) < 0) {
+      if (errno == EINTR) {
+        n = 0;
+        continue;
+      }
+      perror(file ? file : DUNGEON_SAVE_FILE);
+      close(fd);
+
+      return 1;
+    }
+  }
+
+  return close(fd) ? 1 : 0;
+}
+
+/* The semantic, version and size, plus the dimensions in every version *
+ * but 0.                                                               */
+static uint8_t *put_header(dungeon *d, uint8_t *p, uint32_t version,
+                           uint32_t size)
+{
   /* The semantic, which is 6 bytes, 0-11 */
-  fwrite(DUNGEON_SAVE_SEMANTIC, 1, sizeof (DUNGEON_SAVE_SEMANTIC) - 1, f);
+  memcpy(p, DUNGEON_SAVE_SEMANTIC, sizeof (DUNGEON_SAVE_SEMANTIC) - 1);
+  p += sizeof (DUNGEON_SAVE_SEMANTIC) - 1;
 
   /* The version, 4 bytes, 12-15 */
-  be32 = htobe32(DUNGEON_SAVE_VERSION);
-  fwrite(&be32, sizeof (be32), 1, f);
+  p = put_be32(p, version);
 
   /* The size of the file, 4 bytes, 16-19 */
-  be32 = htobe32(calculate_dungeon_size(d));
-  fwrite(&be32, sizeof (be32), 1, f);
+  p = put_be32(p, size);
+
+  /* Not in version 0: the width and height, 2 bytes each, 20-23 */
+  if (version != DUNGEON_SAVE_VERSION) {
+    p = put_be16(p, d->width);
+    p = put_be16(p, d->height);
+  }
+
+  return p;
+}
+
+void dungeon_image(dungeon *d, std::vector<uint8_t> &image)
+{
+  std::vector<uint8_t> plane;
+  uint32_t version, size;
+  uint8_t *p;
+
+  version = save_version(d);
+  size = calculate_dungeon_size(d, version);
+  if (version & DUNGEON_SAVE_COMPRESSED) {
+    /* The hardness gives way to its coded length and its coding.  If *
+     * that doesn't make the file any smaller, it's saved raw.        */
+    rle_encode_plane(d->hardness.data(), d->hardness.size(), 8, plane);
+    size += 4 + plane.size() - d->hardness.size();
+    if (size >= calculate_dungeon_size(d, raw_save_version(d))) {
+      version = raw_save_version(d);
+      size = calculate_dungeon_size(d, version);
+    }
+  }
+  image.resize(size);
+
+  p = put_header(d, image.data(), version, image.size());
 
-  /* The PC position, 2 bytes, 20-21 */
-  fwrite(&d->PC->position[dim_x], 1, 1, f);
-  fwrite(&d->PC->position[dim_y], 1, 1, f);
+  /* The PC position, 2 bytes, 20-21 (4 bytes, 24-27, in version 1) */
+  p = put_coord(p, d->PC->position[dim_x], version);
+  p = put_coord(p, d->PC->position[dim_y], version);
 
   /* The dungeon map, 1680 bytes, 22-1702 */
-  write_dungeon_map(d, f);
+  if (version & DUNGEON_SAVE_COMPRESSED) {
+    p = put_be32(p, plane.size());
+    memcpy(p, plane.data(), plane.size());
+    p += plane.size();
+  } else {
+    p = put_dungeon_map(d, p);
+  }
 
   /* The rooms, num_rooms * 4 bytes, 1703-end */
-  write_rooms(d, f);
+  p = put_rooms(d, p, version);
 
   /* And the stairs */
-  write_stairs(d, f);
+  p = put_stairs(d, p, version);
 
-  fclose(f);
+  assert(p == image.data() + image.size());
+}
 
-  return 0;
+int write_dungeon(dungeon *d, char *file)
+{
+  std::vector<uint8_t> image;
+
+  dungeon_image(d, image);
+
+  return write_save_file(file, image);
 }
 
-int read_dungeon_map(dungeon *d, FILE *f)
+void game_image(dungeon *d, std::vector<uint8_t> &image)
 {
-  uint32_t x, y;
+  uint32_t version;
+  game_state_t s;
+  uint8_t *p;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      fread(&d->hardness[y][x], sizeof (d->hardness[y][x]), 1, f);
-      if (d->hardness[y][x] == 0) {
-        /* Mark it as a corridor.  We can't recognize room cells until *
-         * after we've read the room array, which we haven't done yet. */
-        d->map[y][x] = ter_floor_hall;
-      } else if (d->hardness[y][x] == 255) {
-        d->map[y][x] = ter_wall_immutable;
-      } else {
-        d->map[y][x] = ter_wall;
-      }
-    }
+  capture_game_state(d, &s);
+
+  version = DUNGEON_SAVE_VERSION_GAME;
+  if (s.compressed) {
+    version |= DUNGEON_SAVE_COMPRESSED;
   }
+  image.resize(DUNGEON_SAVE_HEADER_SIZED + game_state_size(&s));
+  p = put_header(d, image.data(), version, image.size());
+  p = write_game_state(&s, p);
 
+  assert(p == image.data() + image.size());
+}
 
-  return 0;
+int write_game(dungeon *d, char *file)
+{
+  std::vector<uint8_t> image;
+
+  if (!pc_is_alive(d)) {
+    fprintf(stderr, "The game is over; there's nothing to checkpoint.\n");
+    return 1;
+  }
+
+  game_image(d, image);
+
+  return write_save_file(file, image);
 }
 
-int read_stairs(dungeon *d, FILE *f)
+static void take_dungeon_map(dungeon *d, save_cursor_t *c, uint32_t version)
+{
+  const uint8_t *h;
+  terrain_type *m;
+  uint32_t size;
+  size_t i;
+
+  if (version & DUNGEON_SAVE_COMPRESSED) {
+    size = take_be32(c);
+    if (rle_decode_plane(take(c, size), size, 8,
+                         d->hardness.data(), d->hardness.size())) {
+      fprintf(stderr, "Invalid dungeon map in restored dungeon.\n");
+      exit(-1);
+    }
+  } else {
+    memcpy(d->hardness.data(), take(c, d->hardness.size()),
+           d->hardness.size());
+  }
+  h = d->hardness.data();
+
+  /* Walls and corridors.  We can't recognize room cells until after *
+   * we've read the room array, which we haven't done yet.           */
+  for (m = d->map.data(), i = 0; i < d->hardness.size(); i++) {
+    if (h[i] == 0) {
+      m[i] = ter_floor_hall;
+    } else if (h[i] == 255) {
+      m[i] = ter_wall_immutable;
+    } else {
+      m[i] = ter_wall;
+    }
+  }
+}
+
+static void take_stairs(dungeon *d, save_cursor_t *c, uint32_t version)
 {
   uint16_t num_stairs;
-  uint8_t x, y;
+  uint32_t x, y;
 
-  fread(&num_stairs, 2, 1, f);
-  num_stairs = be16toh(num_stairs);
-  for (; num_stairs; num_stairs--) {
-    fread(&x, 1, 1, f);
-    fread(&y, 1, 1, f);
+  for (num_stairs = take_be16(c); num_stairs; num_stairs--) {
+    x = take_coord(c, version);
+    y = take_coord(c, version);
+    if (x >= d->width || y >= d->height) {
+      fprintf(stderr, "Invalid stair position in restored dungeon.\n");
+
+      exit(-1);
+    }
     mapxy(x, y) = ter_stairs_up;
   }
 
-  fread(&num_stairs, 2, 1, f);
-  num_stairs = be16toh(num_stairs);
-  for (; num_stairs; num_stairs--) {
-    fread(&x, 1, 1, f);
-    fread(&y, 1, 1, f);
+  for (num_stairs = take_be16(c); num_stairs; num_stairs--) {
+    x = take_coord(c, version);
+    y = take_coord(c, version);
+    if (x >= d->width || y >= d->height) {
+      fprintf(stderr, "Invalid stair position in restored dungeon.\n");
+
+      exit(-1);
+    }
     mapxy(x, y) = ter_stairs_down;
   }
-  return 0;
 }
 
-int read_rooms(dungeon *d, FILE *f)
+static void take_rooms(dungeon *d, save_cursor_t *c, uint32_t version)
 {
   uint32_t i;
   int32_t x, y;
-  uint16_t p;
+  int32_t width = d->width, height = d->height;
 
-  fread(&p, 2, 1, f);
-  d->num_rooms = be16toh(p);
+  d->num_rooms = take_be16(c);
   d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
 
   for (i = 0; i < d->num_rooms; i++) {
-    fread(&p, 1, 1, f);
-    d->rooms[i].position[dim_x] = p;
-    fread(&p, 1, 1, f);
-    d->rooms[i].position[dim_y] = p;
-    fread(&p, 1, 1, f);
-    d->rooms[i].size[dim_x] = p;
-    fread(&p, 1, 1, f);
-    d->rooms[i].size[dim_y] = p;
-
-    if (d->rooms[i].size[dim_x] < 1             ||
-        d->rooms[i].size[dim_y] < 1             ||
-        d->rooms[i].size[dim_x] > DUNGEON_X - 1 ||
-        d->rooms[i].size[dim_y] > DUNGEON_X - 1) {
+    d->rooms[i].position[dim_x] = take_coord(c, version);
+    d->rooms[i].position[dim_y] = take_coord(c, version);
+    d->rooms[i].size[dim_x] = take_coord(c, version);
+    d->rooms[i].size[dim_y] = take_coord(c, version);
+
+    if (d->rooms[i].size[dim_x] < 1         ||
+        d->rooms[i].size[dim_y] < 1         ||
+        d->rooms[i].size[dim_x] > width - 1 ||
+        d->rooms[i].size[dim_y] > width - 1) {
       fprintf(stderr, "Invalid room size in restored dungeon.\n");
 
       exit(-1);
     }
 
-    if (d->rooms[i].position[dim_x] < 1                                       ||
-        d->rooms[i].position[dim_y] < 1                                       ||
-        d->rooms[i].position[dim_x] > DUNGEON_X - 1                           ||
-        d->rooms[i].position[dim_y] > DUNGEON_Y - 1                           ||
-        d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] > DUNGEON_X - 1 ||
-        d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] < 0             ||
-        d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y] > DUNGEON_Y - 1 ||
-        d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y] < 0)             {
+    if (d->rooms[i].position[dim_x] < 1                                    ||
+        d->rooms[i].position[dim_y] < 1                                    ||
+        d->rooms[i].position[dim_x] > width - 1                            ||
+        d->rooms[i].position[dim_y] > height - 1                           ||
+        d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] > width - 1  ||
+        d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] < 0          ||
+        d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y] > height - 1 ||
+        d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y] < 0)          {
       fprintf(stderr, "Invalid room position in restored dungeon.\n");
 
       exit(-1);
@@ -963,171 +1809,293 @@ int read_rooms(dungeon *d, FILE *f)
       }
     }
   }
-
-  return 0;
 }
 
-int read_dungeon(dungeon *d, char *file)
+int read_dungeon_image(dungeon *d, const uint8_t *image, size_t size)
 {
-  char semantic[sizeof (DUNGEON_SAVE_SEMANTIC)];
-  uint32_t be32;
-  FILE *f;
-  const char *home;
-  size_t len;
-  char *filename;
-  struct stat buf;
+  save_cursor_t c;
+  uint32_t version, width, height;
+  pair_t pc_pos;
 
-  if (!file) {
-    if (!(home = getenv("HOME"))) {
-      fprintf(stderr, "\"HOME\" is undefined.  Using working directory.\n");
-      home = ".";
-    }
+  c.p = image;
+  c.end = image + size;
 
-    len = (strlen(home) + strlen(SAVE_DIR) + strlen(DUNGEON_SAVE_FILE) +
-           1 /* The NULL terminator */                                 +
-           2 /* The slashes */);
+  /* Big enough for the semantic, the version and the size; the size is *
+   * checked against the file before anything else is read.             */
+  if (size < sizeof (DUNGEON_SAVE_SEMANTIC) - 1 + 8) {
+    fprintf(stderr, "Not an RLG327 save file.\n");
+    exit(-1);
+  }
 
-    filename = (char *) malloc(len * sizeof (*filename));
-    sprintf(filename, "%s/%s/%s", home, SAVE_DIR, DUNGEON_SAVE_FILE);
+  d->num_rooms = 0;
 
-    if (!(f = fopen(filename, "r"))) {
-      perror(filename);
-      free(filename);
-      exit(-1);
-    }
+  if (memcmp(take(&c, sizeof (DUNGEON_SAVE_SEMANTIC) - 1),
+             DUNGEON_SAVE_SEMANTIC, sizeof (DUNGEON_SAVE_SEMANTIC) - 1)) {
+    fprintf(stderr, "Not an RLG327 save file.\n");
+    exit(-1);
+  }
+  version = take_be32(&c);
+  if (version != DUNGEON_SAVE_VERSION                                   &&
+      (version & ~DUNGEON_SAVE_COMPRESSED) != DUNGEON_SAVE_VERSION_SIZED &&
+      (version & ~DUNGEON_SAVE_COMPRESSED) != DUNGEON_SAVE_VERSION_GAME) {
+    fprintf(stderr, "File version mismatch.\n");
+    exit(-1);
+  }
+  if (size != take_be32(&c)) {
+    fprintf(stderr, "File size mismatch.\n");
+    exit(-1);
+  }
 
-    if (stat(filename, &buf)) {
-      perror(filename);
+  if (version == DUNGEON_SAVE_VERSION) {
+    width = DUNGEON_X;
+    height = DUNGEON_Y;
+  } else {
+    width = take_be16(&c);
+    height = take_be16(&c);
+    if (width < DUNGEON_X || width > MAX_DUNGEON_X ||
+        height < DUNGEON_Y || height > MAX_DUNGEON_Y) {
+      fprintf(stderr, "Invalid dimensions %ux%u in restored dungeon.\n",
+              width, height);
       exit(-1);
     }
+  }
+  if (width != d->width || height != d->height) {
+    d->width = width;
+    d->height = height;
+    size_dungeon(d);
+  }
 
-    free(filename);
+  if ((version & ~DUNGEON_SAVE_COMPRESSED) == DUNGEON_SAVE_VERSION_GAME) {
+    c.p = read_game_state(d, c.p, c.end - c.p,
+                          version & DUNGEON_SAVE_COMPRESSED);
   } else {
-    if (!(f = fopen(file, "r"))) {
-      perror(file);
-      exit(-1);
+    /* The game places its own PC after loading; only tools keep this. */
+    pc_pos[dim_x] = take_coord(&c, version);
+    pc_pos[dim_y] = take_coord(&c, version);
+    if (d->PC) {
+      d->PC->position[dim_x] = pc_pos[dim_x];
+      d->PC->position[dim_y] = pc_pos[dim_y];
     }
-    if (stat(file, &buf)) {
-      perror(file);
+
+    take_dungeon_map(d, &c, version);
+
+    take_rooms(d, &c, version);
+
+    take_stairs(d, &c, version);
+  }
+
+  /* The size in the header has to be the size of what's in the file. */
+  if (c.p != c.end) {
+    fprintf(stderr, "File size mismatch.\n");
+    exit(-1);
+  }
+
+  return 0;
+}
+
+int read_dungeon(dungeon *d, char *file)
+{
+  const uint8_t *level;
+  std::string path;
+  struct stat buf;
+  int64_t number;
+  uint32_t size;
+  void *image;
+  pack_t p;
+  int fd;
+
+  /* A level out of a pack, named "<pack>:<n>". */
+  if (file && pack_name(file, &path, &number)) {
+    if (number < 0 || number > UINT32_MAX) {
+      fprintf(stderr, "Say which level of %s to load, as %s:<n>.\n",
+              path.c_str(), path.c_str());
       exit(-1);
     }
-  }
+    pack_open(&p, path.c_str());
+    level = pack_level(&p, number, &size);
+    read_dungeon_image(d, level, size);
+    pack_close(&p);
 
-  d->num_rooms = 0;
+    return 0;
+  }
 
-  fread(semantic, sizeof (DUNGEON_SAVE_SEMANTIC) - 1, 1, f);
-  semantic[sizeof (DUNGEON_SAVE_SEMANTIC) - 1] = '\0';
-  if (strncmp(semantic, DUNGEON_SAVE_SEMANTIC,
-	      sizeof (DUNGEON_SAVE_SEMANTIC) - 1)) {
-    fprintf(stderr, "Not an RLG327 save file.\n");
+  if ((fd = open_save_file(file, O_RDONLY)) < 0) {
     exit(-1);
   }
-  fread(&be32, sizeof (be32), 1, f);
-  if (be32toh(be32) != 0) { /* Since we expect zero, be32toh() is a no-op. */
-    fprintf(stderr, "File version mismatch.\n");
+  if (fstat(fd, &buf)) {
+    perror(file ? file : DUNGEON_SAVE_FILE);
     exit(-1);
   }
-  fread(&be32, sizeof (be32), 1, f);
-  if (buf.st_size != be32toh(be32)) {
-    fprintf(stderr, "File size mismatch.\n");
+  if (!buf.st_size) {
+    fprintf(stderr, "Not an RLG327 save file.\n");
+    exit(-1);
+  }
+  if ((image = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE,
+                    fd, 0)) == MAP_FAILED) {
+    perror("mmap");
     exit(-1);
   }
+  close(fd);
 
-  fread(&d->PC->position[dim_x], 1, 1, f);
-  fread(&d->PC->position[dim_y], 1, 1, f);
-  
-  read_dungeon_map(d, f);
+  read_dungeon_image(d, (const uint8_t *) image, buf.st_size);
 
-  read_rooms(d, f);
+  munmap(image, buf.st_size);
 
-  read_stairs(d, f);
+  return 0;
+}
 
-  fclose(f);
+/* Reads the next number in a PGM header.  Whitespace, and comments *
+ * from '#' to the end of the line, may come before any field.  Eats *
+ * the single whitespace character after the number, which after the *
+ * last field is all that separates the header from the raster.      */
+static int pgm_field(FILE *f, uint32_t *value)
+{
+  int c;
+
+  for (;;) {
+    if ((c = getc(f)) == '#') {
+      while ((c = getc(f)) != '\n' && c != EOF)
+        ;
+    } else if (!isspace(c)) {
+      break;
+    }
+  }
+  if (!isdigit(c)) {
+    return 1;
+  }
+  for (*value = 0; isdigit(c) && *value < 100000; c = getc(f)) {
+    *value = *value * 10 + (c - '0');
+  }
 
-  return 0;
+  return !isspace(c);
 }
 
-/* PGM dungeon descriptions do not support PC or stairs */
+/* PGM dungeon descriptions do not support PC or stairs.  The image sets *
+ * the size of the dungeon, which gets a wall of immutable rock around   *
+ * it.  Black (0) is room, white (the maximum value) is corridor, and    *
+ * anything between is rock of that hardness.                            *
+ *                                                                       *
+ * The raster is read a row at a time, so images are limited only by the *
+ * largest dungeon.  Rooms are rectangles covering the black cells       *
+ * exactly: a run of black in a row continues the room above it when it  *
+ * spans the same columns, and starts a new one otherwise.  A solid      *
+ * block is then one room, however big, rather than a room per pixel.    */
 int read_pgm(dungeon *d, char *pgm)
 {
+  std::vector<room_t> open, next, rooms;
+  std::vector<uint8_t> row;
+  uint32_t width, height, max, x, y, i, run;
+  uint8_t v;
+  room_t r;
   FILE *f;
-  char s[80];
-  uint8_t gm[DUNGEON_Y - 2][DUNGEON_X - 2];
-  uint32_t x, y;
-  uint32_t i;
-  char size[8]; /* Big enough to hold two 3-digit values with a space between. */
 
   if (!(f = fopen(pgm, "r"))) {
     perror(pgm);
     exit(-1);
   }
 
-  if (!fgets(s, 80, f) || strncmp(s, "P5", 2)) {
+  if (getc(f) != 'P' || getc(f) != '5') {
     fprintf(stderr, "Expected P5\n");
     exit(-1);
   }
-  if (!fgets(s, 80, f) || s[0] != '#') {
-    fprintf(stderr, "Expected comment\n");
+  if (pgm_field(f, &width) || pgm_field(f, &height) || pgm_field(f, &max)) {
+    fprintf(stderr, "Malformed PGM header in %s.\n", pgm);
     exit(-1);
   }
-  snprintf(size, 8, "%d %d", DUNGEON_X - 2, DUNGEON_Y - 2);
-  if (!fgets(s, 80, f) || strncmp(s, size, 5)) {
-    fprintf(stderr, "Expected %s\n", size);
+  if (!max || max > 255) {
+    fprintf(stderr, "Expected a maximum value from 1 to 255, not %u.\n", max);
     exit(-1);
   }
-  if (!fgets(s, 80, f) || strncmp(s, "255", 2)) {
-    fprintf(stderr, "Expected 255\n");
+  if (width < DUNGEON_X - 2U || width > MAX_DUNGEON_X - 2U ||
+      height < DUNGEON_Y - 2U || height > MAX_DUNGEON_Y - 2U) {
+    fprintf(stderr, "Image is %ux%u; it must be from %ux%u to %ux%u.\n",
+            width, height, DUNGEON_X - 2, DUNGEON_Y - 2,
+            MAX_DUNGEON_X - 2, MAX_DUNGEON_Y - 2);
     exit(-1);
   }
 
-  fread(gm, 1, (DUNGEON_X - 2) * (DUNGEON_Y - 2), f);
+  if (width + 2 != d->width || height + 2 != d->height) {
+    d->width = width + 2;
+    d->height = height + 2;
+    size_dungeon(d);
+  }
 
-  fclose(f);
+  row.resize(width);
+  for (y = 1; y < d->height - 1U; y++) {
+    if (fread(row.data(), 1, width, f) != width) {
+      fprintf(stderr, "Truncated image %s.\n", pgm);
+      exit(-1);
+    }
 
-  /* In our gray map, treat black (0) as corridor, white (255) as room, *
-   * all other values as a hardness.  For simplicity, treat every white *
-   * cell as its own room, so we have to count white after reading the  *
-   * image in order to allocate the room array.                         */
-  for (d->num_rooms = 0, y = 0; y < DUNGEON_Y - 2; y++) {
-    for (x = 0; x < DUNGEON_X - 2; x++) {
-      if (!gm[y][x]) {
-        d->num_rooms++;
+    next.clear();
+    for (i = 0, x = 1; x < d->width - 1U; x++) {
+      v = max == 255 ? row[x - 1] : row[x - 1] * 255U / max;
+      if (v == 255) {
+        d->map[y][x] = ter_floor_hall;
+        d->hardness[y][x] = 0;
+      } else if (v) {
+        d->map[y][x] = ter_wall;
+        d->hardness[y][x] = v;
+      } else {
+        d->map[y][x] = ter_floor_room;
+        d->hardness[y][x] = 0;
+      }
+      if (v || (x > 1 && !row[x - 2])) {
+        continue;
       }
-    }
-  }
-  d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
 
-  for (i = 0, y = 0; y < DUNGEON_Y - 2; y++) {
-    for (x = 0; x < DUNGEON_X - 2; x++) {
-      if (!gm[y][x]) {
-        d->rooms[i].position[dim_x] = x + 1;
-        d->rooms[i].position[dim_y] = y + 1;
-        d->rooms[i].size[dim_x] = 1;
-        d->rooms[i].size[dim_y] = 1;
-        i++;
-        d->map[y + 1][x + 1] = ter_floor_room;
-        d->hardness[y + 1][x + 1] = 0;
-      } else if (gm[y][x] == 255) {
-        d->map[y + 1][x + 1] = ter_floor_hall;
-        d->hardness[y + 1][x + 1] = 0;
+      /* x starts a run of black; the open rooms are in column order. */
+      for (run = 1; x + run < d->width - 1U && !row[x + run - 1]; run++)
+        ;
+      while (i < open.size() && open[i].position[dim_x] < (int16_t) x) {
+        rooms.push_back(open[i++]);
+      }
+      if (i < open.size() && open[i].position[dim_x] == (int16_t) x &&
+          open[i].size[dim_x] == (int16_t) run) {
+        open[i].size[dim_y]++;
+        next.push_back(open[i++]);
       } else {
-        d->map[y + 1][x + 1] = ter_wall;
-        d->hardness[y + 1][x + 1] = gm[y][x];
+        r.position[dim_x] = x;
+        r.position[dim_y] = y;
+        r.size[dim_x] = run;
+        r.size[dim_y] = 1;
+        next.push_back(r);
       }
     }
+    while (i < open.size()) {
+      rooms.push_back(open[i++]);
+    }
+    open.swap(next);
+  }
+  for (i = 0; i < open.size(); i++) {
+    rooms.push_back(open[i]);
   }
 
-  for (x = 0; x < DUNGEON_X; x++) {
+  fclose(f);
+
+  /* Saves count the rooms in 16 bits.  Scattered black pixels make a *
+   * room each, so a noisy image can have far more.                   */
+  if (rooms.size() > UINT16_MAX) {
+    fprintf(stderr, "Image %s makes %zu rooms; at most %u will fit in a "
+            "save file.\n", pgm, rooms.size(), UINT16_MAX);
+    exit(-1);
+  }
+
+  d->num_rooms = rooms.size();
+  d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
+  std::copy(rooms.begin(), rooms.end(), d->rooms);
+
+  for (x = 0; x < d->width; x++) {
     d->map[0][x] = ter_wall_immutable;
     d->hardness[0][x] = 255;
-    d->map[DUNGEON_Y - 1][x] = ter_wall_immutable;
-    d->hardness[DUNGEON_Y - 1][x] = 255;
+    d->map[d->height - 1][x] = ter_wall_immutable;
+    d->hardness[d->height - 1][x] = 255;
   }
-  for (y = 1; y < DUNGEON_Y - 1; y++) {
+  for (y = 1; y < d->height - 1U; y++) {
     d->map[y][0] = ter_wall_immutable;
     d->hardness[y][0] = 255;
-    d->map[y][DUNGEON_X - 1] = ter_wall_immutable;
-    d->hardness[y][DUNGEON_X - 1] = 255;
+    d->map[y][d->width - 1] = ter_wall_immutable;
+    d->hardness[y][d->width - 1] = 255;
   }
 
   return 0;
@@ -1143,13 +2111,13 @@ void render_hardness_map(dungeon *d)
   
   putchar('\n');
   printf("   ");
-  for (i = 0; i < DUNGEON_X; i++) {
+  for (i = 0; i < d->width; i++) {
     printf("%2d", i);
   }
   putchar('\n');
-  for (p[dim_y] = 0; p[dim_y] < DUNGEON_Y; p[dim_y]++) {
+  for (p[dim_y] = 0; p[dim_y] < d->height; p[dim_y]++) {
     printf("%2d ", p[dim_y]);
-    for (p[dim_x] = 0; p[dim_x] < DUNGEON_X; p[dim_x]++) {
+    for (p[dim_x] = 0; p[dim_x] < d->width; p[dim_x]++) {
       printf("%02x", hardnesspair(p));
     }
     putchar('\n');
@@ -1161,8 +2129,8 @@ void render_movement_cost_map(dungeon *d)
   pair_t p;
 
   putchar('\n');
-  for (p[dim_y] = 0; p[dim_y] < DUNGEON_Y; p[dim_y]++) {
-    for (p[dim_x] = 0; p[dim_x] < DUNGEON_X; p[dim_x]++) {
+  for (p[dim_y] = 0; p[dim_y] < d->height; p[dim_y]++) {
+    for (p[dim_x] = 0; p[dim_x] < d->width; p[dim_x]++) {
       if (p[dim_x] ==  d->PC->position[dim_x] &&
           p[dim_y] ==  d->PC->position[dim_y]) {
         putchar('@');
@@ -1182,8 +2150,10 @@ void render_distance_map(dungeon *d)
 {
   pair_t p;
 
-  for (p[dim_y] = 0; p[dim_y] < DUNGEON_Y; p[dim_y]++) {
-    for (p[dim_x] = 0; p[dim_x] < DUNGEON_X; p[dim_x]++) {
+  dijkstra_lazy(d);
+
+  for (p[dim_y] = 0; p[dim_y] < d->height; p[dim_y]++) {
+    for (p[dim_x] = 0; p[dim_x] < d->width; p[dim_x]++) {
       if (p[dim_x] ==  d->PC->position[dim_x] &&
           p[dim_y] ==  d->PC->position[dim_y]) {
         putchar('@');
@@ -1200,7 +2170,7 @@ void render_distance_map(dungeon *d)
         case ter_stairs_up:
         case ter_stairs_down:
           /* Placing X for infinity */
-          if (d->pc_distance[p[dim_y]][p[dim_x]] == UCHAR_MAX) {
+          if (d->pc_distance[p[dim_y]][p[dim_x]] == DISTANCE_INFINITY) {
             putchar('X');
           } else {
             putchar('0' + d->pc_distance[p[dim_y]][p[dim_x]] % 10);
@@ -1223,8 +2193,10 @@ void render_tunnel_distance_map(dungeon *d)
 {
   pair_t p;
 
-  for (p[dim_y] = 0; p[dim_y] < DUNGEON_Y; p[dim_y]++) {
-    for (p[dim_x] = 0; p[dim_x] < DUNGEON_X; p[dim_x]++) {
+  dijkstra_tunnel_lazy(d);
+
+  for (p[dim_y] = 0; p[dim_y] < d->height; p[dim_y]++) {
+    for (p[dim_x] = 0; p[dim_x] < d->width; p[dim_x]++) {
       if (p[dim_x] ==  d->PC->position[dim_x] &&
           p[dim_y] ==  d->PC->position[dim_y]) {
         putchar('@');
@@ -1241,7 +2213,7 @@ void render_tunnel_distance_map(dungeon *d)
         case ter_stairs_up:
         case ter_stairs_down:
           /* Placing X for infinity */
-          if (d->pc_tunnel[p[dim_y]][p[dim_x]] == UCHAR_MAX) {
+          if (d->pc_tunnel[p[dim_y]][p[dim_x]] == DISTANCE_INFINITY) {
             putchar('X');
           } else {
             putchar('0' + d->pc_tunnel[p[dim_y]][p[dim_x]] % 10);
@@ -1268,12 +2240,16 @@ void new_dungeon(dungeon *d)
 
   delete_dungeon(d);
 
-  init_dungeon(d);
-  gen_dungeon(d);
+  eventq_init(&d->events, d->event_engine);
+  pregen_next(d);
+  d->is_new = 1;
   d->character_sequence_number = sequence_number;
 
   place_pc(d);
   d->character_map[d->PC->position[dim_y]][d->PC->position[dim_x]] = d->PC;
+  /* Tunnelers repair the maps in place, so they can't be left over *
+   * from the previous level.                                       */
+  dijkstra_invalidate(d);
 
   gen_monsters(d);
   gen_objects(d);
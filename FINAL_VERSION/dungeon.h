@@ -4,12 +4,23 @@
 # include <vector>
 
 # include "heap.h"
+# include "eventq.h"
 # include "dims.h"
 # include "character.h"
 # include "descriptions.h"
+# include "path.h"
+# include "los.h"
+# include "rng.h"
+# include "grid.h"
 
+/* The classic dimensions.  --dims picks others at run time, up to the *
+ * maximums, and init_dungeon() sizes the maps to match.               */
 #define DUNGEON_X              80
 #define DUNGEON_Y              21
+#define MAX_DUNGEON_X          2048
+#define MAX_DUNGEON_Y          2048
+/* Room counts are per DUNGEON_X by DUNGEON_Y of map; larger dungeons *
+ * get proportionally more rooms.                                      */
 #define MIN_ROOMS              6
 #define MAX_ROOMS              10
 #define ROOM_MIN_X             4
@@ -27,12 +38,112 @@
 #define DUNGEON_SAVE_FILE      "dungeon"
 #define DUNGEON_SAVE_SEMANTIC  "RLG327-" TERM
 #define DUNGEON_SAVE_VERSION   0U
+/* Version 0 files are always DUNGEON_X by DUNGEON_Y with byte-sized *
+ * coordinates.  Any other size is saved as version 1, which adds    *
+ * the dimensions to the header and widens coordinates to 16 bits.   */
+#define DUNGEON_SAVE_VERSION_SIZED 1U
+/* Version 2 files have the version 1 header and checkpoint a whole *
+ * game: monsters, objects, the PC and the event queue; see save.h. */
+#define DUNGEON_SAVE_VERSION_GAME  2U
+/* Or'd into version 1 and 2 to mark their cell planes as run-length *
+ * coded; see save_encoding_t.  Compressed dungeons of the classic   *
+ * size load as version 1 too, since version 0 has no room for the   *
+ * flag, though they are no longer written.  A dungeon that coding   *
+ * wouldn't make any smaller is saved raw.                           */
+#define DUNGEON_SAVE_COMPRESSED    0x100U
 #define MONSTER_DESC_FILE      "monster_desc.txt"
 #define OBJECT_DESC_FILE       "object_desc.txt"
+/* Appended to the description file names for their binary caches. */
+#define DESC_CACHE_SUFFIX      ".cache"
 #define MAX_INVENTORY          10
 #define poisDamage 100
 #define poisDecreaseBy 25
 
+/* Two engines route the corridors between rooms.  The dijkstra engine *
+ * is the original full-map search on the Fibonacci heap.  The astar   *
+ * engine searches toward the target and stops when it gets there,    *
+ * reusing one open set for every corridor.  At 80x21 both find      *
+ * corridors of the same (least) cost, but where several are equally   *
+ * cheap they may pick different ones, so a seed's dungeon depends on  *
+ * the engine.  On bigger maps astar searches only a window around the *
+ * two ends, and its corridors are the cheapest within the window.     *
+ * Override the default at build time with                             *
+ * -DDEFAULT_CORRIDOR_ENGINE=corridor_engine_dijkstra, or at run time  *
+ * with the --corridors switch.                                        */
+typedef enum corridor_engine {
+  corridor_engine_dijkstra,
+  corridor_engine_astar,
+  num_corridor_engines
+} corridor_engine_t;
+
+# ifndef DEFAULT_CORRIDOR_ENGINE
+#  define DEFAULT_CORRIDOR_ENGINE corridor_engine_astar
+# endif
+
+extern const char *corridor_engine_name[num_corridor_engines];
+
+/* Two engines build the hardness map, and both build the same one.   *
+ * The list engine is the original: a flood fill through a malloc'd   *
+ * linked list, then a direct 5x5 Gaussian with bounds checks on every *
+ * tap.  The array engine floods through one reused array and filters  *
+ * a zero-padded copy in separable passes.  Override the default at    *
+ * build time with -DDEFAULT_HARDNESS_ENGINE=hardness_engine_list.     */
+typedef enum hardness_engine {
+  hardness_engine_list,
+  hardness_engine_array,
+  num_hardness_engines
+} hardness_engine_t;
+
+# ifndef DEFAULT_HARDNESS_ENGINE
+#  define DEFAULT_HARDNESS_ENGINE hardness_engine_array
+# endif
+
+extern const char *hardness_engine_name[num_hardness_engines];
+
+/* Two engines place the rooms.  The restart engine is the original:    *
+ * any overlap throws away every room placed so far, along with the     *
+ * hardness map, and starts over.  The bitmap engine keeps an occupancy *
+ * bitmap, draws again for only the room that collided, gives up on a   *
+ * room that can't be placed, and then orders the rooms so that each is *
+ * near the next, which keeps the corridors between them short.  It     *
+ * makes different dungeons from the same seed.  Override the default  *
+ * at build time with -DDEFAULT_ROOM_ENGINE=room_engine_restart, or at  *
+ * run time with the --placement switch.                                */
+typedef enum room_engine {
+  room_engine_restart,
+  room_engine_bitmap,
+  num_room_engines
+} room_engine_t;
+
+# ifndef DEFAULT_ROOM_ENGINE
+#  define DEFAULT_ROOM_ENGINE room_engine_bitmap
+# endif
+
+extern const char *room_engine_name[num_room_engines];
+
+/* Two encodings for save files.  The raw encoding writes the cell    *
+ * planes (hardness, and in checkpoints the terrain and what the PC  *
+ * knows and sees) a byte per cell, as the spec has it.  The rle     *
+ * encoding packs terrain into 4 bits a cell and visibility into 1,  *
+ * and run-length codes every plane; see rle.h.  At the classic      *
+ * 80x21, though, rle saves raw too: those files are small and get   *
+ * reloaded often, and decoding would cost more than it saves; see   *
+ * save_compressed().  Loading handles either, whatever the setting. *
+ * Override the default at build time with                           *
+ * -DDEFAULT_SAVE_ENCODING=save_encoding_rle, or at run time with    *
+ * the --encoding switch.                                            */
+typedef enum save_encoding {
+  save_encoding_raw,
+  save_encoding_rle,
+  num_save_encodings
+} save_encoding_t;
+
+# ifndef DEFAULT_SAVE_ENCODING
+#  define DEFAULT_SAVE_ENCODING save_encoding_raw
+# endif
+
+extern const char *save_encoding_name[num_save_encodings];
+
 #define mappair(pair) (d->map[pair[dim_y]][pair[dim_x]])
 #define mapxy(x, y) (d->map[y][x])
 #define hardnesspair(pair) (d->hardness[pair[dim_y]][pair[dim_x]])
@@ -62,17 +173,30 @@ typedef struct room {
 
 class pc;
 class object;
+struct pregen;
 
 class dungeon {
  public:
-  dungeon() : num_rooms(0), rooms(0), map{ter_wall}, hardness{0},
-              pc_distance{0}, pc_tunnel{0}, character_map{0}, PC(0),
+  dungeon() : num_rooms(0), rooms(0), width(DUNGEON_X), height(DUNGEON_Y),
+              map(), hardness(), pc_distance(), pc_tunnel(), character_map(),
+              objmap(), PC(0),
               num_monsters(0), max_monsters(0), character_sequence_number(0),
-              time(0), is_new(0), quit(0), monster_descriptions(),
-              object_descriptions() {}
+              event_sequence_number(0), time(0), is_new(0), quit(0),
+              path_engine(DEFAULT_PATH_ENGINE),
+              event_engine(DEFAULT_EVENT_ENGINE),
+              corridor_engine(DEFAULT_CORRIDOR_ENGINE),
+              hardness_engine(DEFAULT_HARDNESS_ENGINE),
+              room_engine(DEFAULT_ROOM_ENGINE),
+              los_engine(DEFAULT_LOS_ENGINE),
+              save_encoding(DEFAULT_SAVE_ENCODING), pc_distance_dirty(1), pc_tunnel_dirty(1), pc_distance_stats(),
+              pc_tunnel_stats(), monster_descriptions(),
+              object_descriptions(), rand(), seed(0), level(0),
+              pregen(0) {}
   uint32_t num_rooms;
   room_t *rooms;
-  terrain_type map[DUNGEON_Y][DUNGEON_X];
+  uint16_t width;
+  uint16_t height;
+  grid<terrain_type> map;
   /* Since hardness is usually not used, it would be expensive to pull it *
    * into cache every time we need a map cell, so we store it in a        *
    * parallel array, rather than using a structure to represent the       *
@@ -81,18 +205,20 @@ class dungeon {
    * that structure.  Pathfinding will require efficient use of the map,  *
    * and pulling in unnecessary data with each map cell would add a lot   *
    * of overhead to the memory system.                                    */
-  uint8_t hardness[DUNGEON_Y][DUNGEON_X];
-  uint8_t pc_distance[DUNGEON_Y][DUNGEON_X];
-  uint8_t pc_tunnel[DUNGEON_Y][DUNGEON_X];
-  character *character_map[DUNGEON_Y][DUNGEON_X];
-  object *objmap[DUNGEON_Y][DUNGEON_X];
+  grid<uint8_t> hardness;
+  grid<distance_t> pc_distance;
+  grid<distance_t> pc_tunnel;
+  grid<character *> character_map;
+  grid<object *> objmap;
   pc *PC;
-  heap_t events;
-  uint16_t num_monsters;
-  uint16_t max_monsters;
+  eventq_t events;
+  uint32_t num_monsters;
+  uint32_t max_monsters;
   uint16_t num_objects;
   uint16_t max_objects;
    uint32_t character_sequence_number;
+  /* Tie-breaker for events at the same time; see event.cpp. */
+  uint32_t event_sequence_number;
   /* Game time isn't strictly necessary.  It's implicit in the turn number *
    * of the most recent thing removed from the event queue; however,       *
    * including it here--and keeping it up to date--provides a measure of   *
@@ -101,17 +227,47 @@ class dungeon {
   uint32_t time;
   uint32_t is_new;
   uint32_t quit;
+  path_engine_t path_engine;
+  event_engine_t event_engine;
+  corridor_engine_t corridor_engine;
+  hardness_engine_t hardness_engine;
+  room_engine_t room_engine;
+  los_engine_t los_engine;
+  save_encoding_t save_encoding;
+  /* Don't read pc_distance or pc_tunnel without calling dijkstra_lazy() *
+   * or dijkstra_tunnel_lazy(), respectively.  See path.h.               */
+  uint32_t pc_distance_dirty;
+  uint32_t pc_tunnel_dirty;
+  path_stats_t pc_distance_stats;
+  path_stats_t pc_tunnel_stats;
   std::vector<monster_description> monster_descriptions;
   std::vector<object_description> object_descriptions;
+  /* All of the game's randomness; see rng.h.  Seed it before use. */
+  rng rand;
+  /* Levels after the first are generated from their own streams of *
+   * the game's seed, not from rand; see pregen.h.                   */
+  uint64_t seed;
+  uint32_t level;
+  struct pregen *pregen;
 };
 
 void init_dungeon(dungeon *d);
 void new_dungeon(dungeon *d);
 void delete_dungeon(dungeon *d);
 int gen_dungeon(dungeon *d);
+void smooth_hardness(dungeon *d);
 void render_dungeon(dungeon *d);
 int write_dungeon(dungeon *d, char *file);
+int write_game(dungeon *d, char *file);
 int read_dungeon(dungeon *d, char *file);
+/* The save files write_dungeon() and write_game() would write, and *
+ * the reader under read_dungeon(), for save files that live        *
+ * somewhere other than a file of their own; see pack.h.            */
+void dungeon_image(dungeon *d, std::vector<uint8_t> &image);
+void game_image(dungeon *d, std::vector<uint8_t> &image);
+int read_dungeon_image(dungeon *d, const uint8_t *image, size_t size);
+/* Whether d's saves run-length code their cell planes. */
+int save_compressed(dungeon *d);
 int read_pgm(dungeon *d, char *pgm);
 void render_distance_map(dungeon *d);
 void render_tunnel_distance_map(dungeon *d);
@@ -16,11 +16,22 @@ struct event {
   union {
     character *c;
   };
+  event *next; /* Timing wheel slot, or the pool's free list */
 };
 
+/* The queue order.  Differences are taken modulo 2^32, so times and *
+ * sequence numbers may wrap.                                        */
+static inline int32_t event_compare(const event *e1, const event *e2)
+{
+  int32_t difference;
+
+  difference = e1->time - e2->time;
+  return difference ? difference : (int32_t) (e1->sequence - e2->sequence);
+}
+
 int32_t compare_events(const void *event1, const void *event2);
 event *new_event(dungeon *d, eventype_t t, void *v, uint32_t delay);
 event *update_event(dungeon *d, event *e, uint32_t delay);
-void event_delete(void *e);
+void event_delete(dungeon *d, event *e);
 
 #endif
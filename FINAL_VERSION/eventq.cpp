@@ -0,0 +1,296 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include "eventq.h"
+#include "event.h"
+#include "utils.h"
+
+const char *event_engine_name[num_event_engines] = {
+  "fibonacci",
+  "dary",
+  "wheel"
+};
+
+/* Events are carved out of chunks of this many and recycled through *
+ * a free list.  Chunks are only returned by eventq_delete().         */
+#define EVENTQ_CHUNK 256
+
+struct eventq_chunk {
+  struct eventq_chunk *next;
+  event e[EVENTQ_CHUNK];
+};
+
+struct eventq_slot {
+  event *head;
+  event *tail;
+};
+
+void eventq_init(eventq_t *q, event_engine_t engine)
+{
+  q->engine = engine;
+  heap_init(&q->fib, compare_events, NULL);
+  q->ev = NULL;
+  q->size = q->alloc = 0;
+  q->slot = NULL;
+  if (engine == event_engine_wheel) {
+    q->slot = (struct eventq_slot *) calloc(EVENTQ_SLOTS, sizeof (*q->slot));
+  }
+  memset(q->occupied, 0, sizeof (q->occupied));
+  q->now = 0;
+  q->wheel_size = 0;
+  q->chunks = NULL;
+  q->free_list = NULL;
+}
+
+void eventq_delete(eventq_t *q)
+{
+  struct eventq_chunk *c;
+
+  heap_delete(&q->fib);
+  free(q->ev);
+  q->ev = NULL;
+  q->size = q->alloc = 0;
+  free(q->slot);
+  q->slot = NULL;
+  memset(q->occupied, 0, sizeof (q->occupied));
+  q->wheel_size = 0;
+
+  while ((c = q->chunks)) {
+    q->chunks = c->next;
+    free(c);
+  }
+  q->free_list = NULL;
+}
+
+static void dary_sift_up(eventq_t *q, uint32_t i, event *e)
+{
+  uint32_t parent;
+
+  while (i && event_compare(e, q->ev[(parent = (i - 1) / EVENTQ_ARITY)]) < 0) {
+    q->ev[i] = q->ev[parent];
+    i = parent;
+  }
+  q->ev[i] = e;
+}
+
+static void dary_sift_down(eventq_t *q, uint32_t i, event *e)
+{
+  uint32_t child, end, min;
+
+  while ((child = i * EVENTQ_ARITY + 1) < q->size) {
+    end = child + EVENTQ_ARITY;
+    if (end > q->size) {
+      end = q->size;
+    }
+    for (min = child++; child < end; child++) {
+      if (event_compare(q->ev[child], q->ev[min]) < 0) {
+        min = child;
+      }
+    }
+    if (event_compare(q->ev[min], e) >= 0) {
+      break;
+    }
+    q->ev[i] = q->ev[min];
+    i = min;
+  }
+  q->ev[i] = e;
+}
+
+static void dary_insert(eventq_t *q, event *e)
+{
+  if (q->size == q->alloc) {
+    q->alloc = q->alloc ? q->alloc * 2 : 64;
+    if (!(q->ev = (event **) realloc(q->ev, q->alloc * sizeof (*q->ev)))) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+
+  dary_sift_up(q, q->size++, e);
+}
+
+static event *dary_remove_min(eventq_t *q)
+{
+  event *e;
+
+  if (!q->size) {
+    return NULL;
+  }
+
+  e = q->ev[0];
+  if (--q->size) {
+    dary_sift_down(q, 0, q->ev[q->size]);
+  }
+
+  return e;
+}
+
+static void wheel_insert(eventq_t *q, event *e)
+{
+  struct eventq_slot *s;
+  uint32_t i;
+  event *p;
+
+  if (e->time - q->now >= EVENTQ_SLOTS) {
+    dary_insert(q, e);
+
+    return;
+  }
+
+  i = e->time & (EVENTQ_SLOTS - 1);
+  s = q->slot + i;
+  if (!s->head) {
+    e->next = NULL;
+    s->head = s->tail = e;
+    q->occupied[i / 64] |= 1ULL << (i % 64);
+  } else if (event_compare(s->tail, e) < 0) {
+    /* The usual case, since sequence numbers only go up. */
+    e->next = NULL;
+    s->tail->next = e;
+    s->tail = e;
+  } else if (event_compare(e, s->head) < 0) {
+    /* The PC, whose sequence number is always 0. */
+    e->next = s->head;
+    s->head = e;
+  } else {
+    for (p = s->head; p->next && event_compare(p->next, e) < 0; p = p->next)
+      ;
+    e->next = p->next;
+    p->next = e;
+  }
+  q->wheel_size++;
+}
+
+/* First occupied slot at or after now, wrapping around.  The wheel *
+ * must not be empty.                                               */
+static uint32_t wheel_next_slot(eventq_t *q)
+{
+  uint32_t i, w;
+  uint64_t bits;
+
+  i = q->now & (EVENTQ_SLOTS - 1);
+  w = i / 64;
+  bits = q->occupied[w] & (~0ULL << (i % 64));
+  for (i = 0; !bits && i < EVENTQ_SLOTS / 64; i++) {
+    w = (w + 1) % (EVENTQ_SLOTS / 64);
+    bits = q->occupied[w];
+  }
+
+  return w * 64 + __builtin_ctzll(bits);
+}
+
+static event *wheel_remove_min(eventq_t *q)
+{
+  struct eventq_slot *s;
+  uint32_t i;
+  event *e;
+
+  if (!q->wheel_size) {
+    e = dary_remove_min(q);
+  } else {
+    i = wheel_next_slot(q);
+    s = q->slot + i;
+    e = s->head;
+    if (q->size && event_compare(q->ev[0], e) < 0) {
+      e = dary_remove_min(q);
+    } else {
+      if (!(s->head = e->next)) {
+        s->tail = NULL;
+        q->occupied[i / 64] &= ~(1ULL << (i % 64));
+      }
+      q->wheel_size--;
+    }
+  }
+
+  /* Everything left in the wheel is at least this late, so the wheel *
+   * can move up to here.                                             */
+  if (e) {
+    q->now = e->time;
+  }
+
+  return e;
+}
+
+void eventq_insert(eventq_t *q, event *e)
+{
+  switch (q->engine) {
+  case event_engine_fibonacci:
+    heap_insert(&q->fib, e);
+    break;
+  case event_engine_dary:
+    dary_insert(q, e);
+    break;
+  case event_engine_wheel:
+    wheel_insert(q, e);
+    break;
+  default:
+    break;
+  }
+}
+
+event *eventq_remove_min(eventq_t *q)
+{
+  switch (q->engine) {
+  case event_engine_fibonacci:
+    return (event *) heap_remove_min(&q->fib);
+  case event_engine_dary:
+    return dary_remove_min(q);
+  case event_engine_wheel:
+    return wheel_remove_min(q);
+  default:
+    return NULL;
+  }
+}
+
+uint32_t eventq_size(eventq_t *q)
+{
+  return (q->engine == event_engine_fibonacci ?
+          q->fib.size : q->size + q->wheel_size);
+}
+
+void eventq_list(eventq_t *q, event **out)
+{
+  uint32_t i, n, now;
+  event *e;
+
+  /* Every engine can give them up in order, and taking them all out *
+   * and putting them back leaves the order as it was.  The wheel is  *
+   * rewound so that they go back into the same slots.                */
+  now = q->now;
+  for (n = 0; (e = eventq_remove_min(q)); n++) {
+    out[n] = e;
+  }
+  q->now = now;
+  for (i = 0; i < n; i++) {
+    eventq_insert(q, out[i]);
+  }
+}
+
+event *eventq_alloc(eventq_t *q)
+{
+  struct eventq_chunk *c;
+  event *e;
+  uint32_t i;
+
+  if (!q->free_list) {
+    c = (struct eventq_chunk *) malloc(sizeof (*c));
+    c->next = q->chunks;
+    q->chunks = c;
+    for (i = 0; i < EVENTQ_CHUNK; i++) {
+      c->e[i].next = q->free_list;
+      q->free_list = c->e + i;
+    }
+  }
+
+  e = q->free_list;
+  q->free_list = e->next;
+
+  return e;
+}
+
+void eventq_free(eventq_t *q, event *e)
+{
+  e->next = q->free_list;
+  q->free_list = e;
+}
@@ -0,0 +1,75 @@
+#ifndef EVENTQ_H
+# define EVENTQ_H
+
+# include <stdint.h>
+
+# include "heap.h"
+
+/* The event queue, ordered by compare_events(): earliest time first, *
+ * ties broken by sequence number.  The fibonacci engine is the       *
+ * original heap.c queue, which mallocs a node for every insert.  The *
+ * dary engine is an implicit 4-ary heap in one growable array, which *
+ * allocates nothing in steady state.  The wheel engine is a timing   *
+ * wheel (calendar queue) with a slot per game tick, see below.  All  *
+ * pop events in exactly the same order.  Override the default at     *
+ * build time with -DDEFAULT_EVENT_ENGINE=event_engine_fibonacci, or  *
+ * at run time with the --events switch.                              *
+ *                                                                    *
+ * Either way, events themselves come from a pool owned by the queue  *
+ * (eventq_alloc() and eventq_free()), so the PC's turn, which is     *
+ * created and destroyed every time around, costs no malloc().        */
+typedef enum event_engine {
+  event_engine_fibonacci,
+  event_engine_dary,
+  event_engine_wheel,
+  num_event_engines
+} event_engine_t;
+
+# ifndef DEFAULT_EVENT_ENGINE
+#  define DEFAULT_EVENT_ENGINE event_engine_wheel
+# endif
+
+# define EVENTQ_ARITY 4
+
+/* Turns are 1000 / speed ticks apart, and speed is at least 1, so  *
+ * with 1024 slots almost every event lands in the wheel: slot      *
+ * time % EVENTQ_SLOTS, kept in sequence order, all events in it    *
+ * due at the same tick.  Anything further out than that (or in     *
+ * the past) waits in the dary heap, and remove_min() takes the     *
+ * earlier of the two.  A bitmap of occupied slots finds the next   *
+ * due event without walking empty ticks.  Must be a power of two.  */
+# define EVENTQ_SLOTS 1024
+
+extern const char *event_engine_name[num_event_engines];
+
+struct event;
+struct eventq_chunk;
+
+typedef struct eventq {
+  event_engine_t engine;
+  heap_t fib;
+  struct event **ev;
+  uint32_t size;
+  uint32_t alloc;
+  struct eventq_slot *slot;
+  uint64_t occupied[EVENTQ_SLOTS / 64];
+  uint32_t now;
+  uint32_t wheel_size;
+  struct eventq_chunk *chunks;
+  struct event *free_list;
+} eventq_t;
+
+void eventq_init(eventq_t *q, event_engine_t engine);
+/* Frees the queue and the pool.  Doesn't touch what the events refer *
+ * to, so drain it first if that matters.                             */
+void eventq_delete(eventq_t *q);
+void eventq_insert(eventq_t *q, struct event *e);
+struct event *eventq_remove_min(eventq_t *q);
+uint32_t eventq_size(eventq_t *q);
+/* Fills out, which must have room for eventq_size() of them, with the *
+ * queued events in the order they'll come out, and leaves them queued. */
+void eventq_list(eventq_t *q, struct event **out);
+struct event *eventq_alloc(eventq_t *q);
+void eventq_free(eventq_t *q, struct event *e);
+
+#endif
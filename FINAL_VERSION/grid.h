@@ -0,0 +1,50 @@
+#ifndef GRID_H
+# define GRID_H
+
+# include <stdint.h>
+# include <stddef.h>
+# include <vector>
+# include <algorithm>
+
+/* A two-dimensional array sized at run time.  The cells are stored flat *
+ * in row-major order, and g[y][x] indexes them just like the fixed-size *
+ * arrays this replaced, so code that walks a row with a pointer, or     *
+ * steps a flat index by width() to get to the next row, still works.    */
+template <class T>
+class grid {
+ private:
+  uint32_t w, h;
+  std::vector<T> cells;
+ public:
+  grid() : w(0), h(0), cells() {}
+  /* Reuses the existing allocation when the size doesn't grow. */
+  void resize(uint32_t width, uint32_t height, const T &value)
+  {
+    w = width;
+    h = height;
+    cells.assign((size_t) width * height, value);
+  }
+  void fill(const T &value)
+  {
+    std::fill(cells.begin(), cells.end(), value);
+  }
+  T *operator[](uint32_t y) { return cells.data() + (size_t) y * w; }
+  const T *operator[](uint32_t y) const
+  {
+    return cells.data() + (size_t) y * w;
+  }
+  /* Trades contents with another grid without copying any cells. */
+  void swap(grid &other)
+  {
+    std::swap(w, other.w);
+    std::swap(h, other.h);
+    cells.swap(other.cells);
+  }
+  T *data() { return cells.data(); }
+  const T *data() const { return cells.data(); }
+  uint32_t width() const { return w; }
+  uint32_t height() const { return h; }
+  size_t size() const { return cells.size(); }
+};
+
+#endif
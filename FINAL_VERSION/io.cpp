@@ -1,4 +1,6 @@
 #include <unistd.h>
+#include <poll.h>
+#include <time.h>
 #include <ncurses.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -15,16 +17,137 @@
 #include "character.h"
 
 /* Same ugly hack we did in path.c */
-static dungeon *thedungeon;
+static thread_local dungeon *thedungeon;
+
+/* Messages live in a ring of IO_MESSAGE_LOG slots: those not yet shown, *
+ * and before them the most recent that have been, which 'M' scrolls     *
+ * back through.  io_message_next and io_message_shown count the messages *
+ * ever queued and ever shown; message n is in slot n % IO_MESSAGE_LOG.   *
+ * Should more than IO_MESSAGE_LOG pile up unshown, the oldest are lost.  */
+#define IO_MESSAGE_LOG 256
+
+/* Will print " --more-- " at end of line when another message follows. *
+ * Leave 10 extra spaces for that.                                      */
+static char io_message[IO_MESSAGE_LOG][71];
+static uint32_t io_message_next, io_message_shown;
+
+/* Headless games write their messages to io_log, if it's open, each line *
+ * tagged with the seed of the game, since a simulation plays many at      *
+ * once.  Lines are written whole, so the games' lines interleave but     *
+ * never mix.                                                             */
+#define IO_LOG_BUFFER (1 << 16)
+#define IO_LOG_LINE   256
+
+static FILE *io_log;
+static thread_local uint64_t io_log_seed;
+
+/* Headless games never touch the terminal.  Messages go to io_log if  *
+ * -m/--log opened one, and are dropped otherwise.  The display is     *
+ * skipped, and the PC plays itself via pc_autopilot().                */
+static uint32_t io_headless;
+
+/* Multicolored monsters flicker.  That comes from here rather than the *
+ * dungeon's generator, so that drawing never changes how a game plays. */
+static rng io_rng;
+
+/* How many times a second they do it, while any is on screen.  0 holds *
+ * them still.                                                          */
+static uint32_t io_animation_hz = DEFAULT_ANIMATION_HZ;
+
+/* The screen is a DUNGEON_X by DUNGEON_Y window onto the map, which is *
+ * all of a dungeon of the classic size.  On a bigger map the window    *
+ * follows the PC (or the teleport cursor), recentering when it gets    *
+ * within a quarter of the window of an edge.  io_view is the map cell  *
+ * in the window's top left corner.                                     */
+static uint16_t io_view[num_dims];
+
+static uint32_t io_follow(dungeon *d, pair_t p)
+{
+  int32_t x, y;
+
+  x = io_view[dim_x];
+  y = io_view[dim_y];
+  if (p[dim_x] < x + DUNGEON_X / 4 || p[dim_x] >= x + DUNGEON_X * 3 / 4) {
+    x = p[dim_x] - DUNGEON_X / 2;
+  }
+  if (p[dim_y] < y + DUNGEON_Y / 4 || p[dim_y] >= y + DUNGEON_Y * 3 / 4) {
+    y = p[dim_y] - DUNGEON_Y / 2;
+  }
+  x = x > d->width - DUNGEON_X ? d->width - DUNGEON_X : x;
+  y = y > d->height - DUNGEON_Y ? d->height - DUNGEON_Y : y;
+  x = x < 0 ? 0 : x;
+  y = y < 0 ? 0 : y;
+
+  if (x == io_view[dim_x] && y == io_view[dim_y]) {
+    return 0;
+  }
+  io_view[dim_x] = x;
+  io_view[dim_y] = y;
+
+  return 1;
+}
+
+/* The map window is drawn into io_frame and sent to the terminal by   *
+ * io_flush_frame(), which writes only the cells that differ from       *
+ * io_shown, what was last sent, a run of cells with the same attributes *
+ * at a time.  A cell is its glyph or'd with its color pair and bold, so *
+ * cells compare as chtypes.  Anything else that draws over the map     *
+ * (the menus, the debugging maps) calls io_frame_invalidate(), so that *
+ * the next flush writes every cell.  Otherwise every PC turn would      *
+ * clear() and repaint all 1680 cells, which is most of the traffic on a *
+ * remote terminal.                                                      */
+static chtype io_frame[DUNGEON_Y][DUNGEON_X];
+static chtype io_shown[DUNGEON_Y][DUNGEON_X];
+
+/* No drawn cell is ever 0, so every cell differs from this. */
+static void io_frame_invalidate(void)
+{
+  memset(io_shown, 0, sizeof (io_shown));
+}
+
+static void io_flush_frame(void)
+{
+  char run[DUNGEON_X];
+  chtype attrs;
+  int32_t y, x, start, n;
+
+  for (y = 0; y < DUNGEON_Y; y++) {
+    for (x = 0; x < DUNGEON_X; ) {
+      if (io_frame[y][x] == io_shown[y][x]) {
+        x++;
+        continue;
+      }
+      attrs = io_frame[y][x] & A_ATTRIBUTES;
+      for (start = x, n = 0;
+           (x < DUNGEON_X && io_frame[y][x] != io_shown[y][x] &&
+            (io_frame[y][x] & A_ATTRIBUTES) == attrs);
+           x++) {
+        run[n++] = io_frame[y][x] & A_CHARTEXT;
+        io_shown[y][x] = io_frame[y][x];
+      }
+      attrset(attrs);
+      mvaddnstr(y + 1, start, run, n);
+    }
+  }
+  attrset(A_NORMAL);
+}
 
-typedef struct io_message {
-  /* Will print " --more-- " at end of line when another message follows. *
-   * Leave 10 extra spaces for that.                                      */
-  char msg[71];
-  struct io_message *next;
-} io_message_t;
+/* Draws the map cell at (x, y), in whatever color and boldness are on; *
+ * cells outside the window are skipped.  Row 0 of the screen is for    *
+ * messages.  Nothing shows until io_flush_frame().                     */
+static void io_map_addch(int32_t y, int32_t x, chtype c)
+{
+  y -= io_view[dim_y];
+  x -= io_view[dim_x];
+  if (y >= 0 && y < DUNGEON_Y && x >= 0 && x < DUNGEON_X) {
+    io_frame[y][x] = c | (getattrs(stdscr) & (A_COLOR | A_BOLD));
+  }
+}
 
-static io_message_t *io_head, *io_tail;
+void io_init_headless(void)
+{
+  io_headless = 1;
+}
 
 void io_init_terminal(void)
 {
@@ -45,95 +168,123 @@ void io_init_terminal(void)
 
 void io_reset_terminal(void)
 {
-  endwin();
+  if (!io_headless) {
+    endwin();
+  }
+
+  io_message_shown = io_message_next;
+
+  if (io_log) {
+    fclose(io_log);
+    io_log = NULL;
+  }
+}
+
+void io_set_animation(uint32_t hz)
+{
+  io_animation_hz = hz;
+}
 
-  while (io_head) {
-    io_tail = io_head;
-    io_head = io_head->next;
-    free(io_tail);
+int io_open_log(const char *file)
+{
+  if (!(io_log = fopen(file, "w"))) {
+    perror(file);
+    return 1;
   }
-  io_tail = NULL;
+  setvbuf(io_log, NULL, _IOFBF, IO_LOG_BUFFER);
+
+  return 0;
+}
+
+void io_log_game(uint64_t seed)
+{
+  io_log_seed = seed;
 }
 
 void io_queue_message(const char *format, ...)
 {
-  io_message_t *tmp;
+  char line[IO_LOG_LINE];
   va_list ap;
 
-  if (!(tmp = (io_message_t *) malloc(sizeof (*tmp)))) {
-    perror("malloc");
-    exit(1);
+  if (io_headless) {
+    if (io_log) {
+      va_start(ap, format);
+      vsnprintf(line, sizeof (line), format, ap);
+      va_end(ap);
+      fprintf(io_log, "%llu %s\n", (unsigned long long) io_log_seed, line);
+    }
+    return;
   }
 
-  tmp->next = NULL;
+  if (io_message_next - io_message_shown == IO_MESSAGE_LOG) {
+    io_message_shown++;
+  }
 
   va_start(ap, format);
 
-  vsnprintf(tmp->msg, sizeof (tmp->msg), format, ap);
+  vsnprintf(io_message[io_message_next % IO_MESSAGE_LOG],
+            sizeof (io_message[0]), format, ap);
 
   va_end(ap);
 
-  if (!io_head) {
-    io_head = io_tail = tmp;
-  } else {
-    io_tail->next = tmp;
-    io_tail = tmp;
-  }
+  io_message_next++;
 }
 
 static void io_print_message_queue(uint32_t y, uint32_t x)
 {
-  while (io_head) {
-    io_tail = io_head;
+  while (io_message_shown != io_message_next) {
     attron(COLOR_PAIR(COLOR_CYAN));
-    mvprintw(y, x, "%-80s", io_head->msg);
+    mvprintw(y, x, "%-80s", io_message[io_message_shown++ % IO_MESSAGE_LOG]);
     attroff(COLOR_PAIR(COLOR_CYAN));
-    io_head = io_head->next;
-    if (io_head) {
+    if (io_message_shown != io_message_next) {
       attron(COLOR_PAIR(COLOR_CYAN));
       mvprintw(y, x + 70, "%10s", " --more-- ");
       attroff(COLOR_PAIR(COLOR_CYAN));
       refresh();
       getch();
     }
-    free(io_tail);
   }
-  io_tail = NULL;
 }
 
 void io_display_tunnel(dungeon *d)
 {
-  uint32_t y, x;
+  int32_t y, x;
+  dijkstra_tunnel_lazy(d);
   clear();
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  io_frame_invalidate();
+  for (y = io_view[dim_y]; y < io_view[dim_y] + DUNGEON_Y; y++) {
+    for (x = io_view[dim_x]; x < io_view[dim_x] + DUNGEON_X; x++) {
       if (charxy(x, y) == d->PC) {
-        mvaddch(y + 1, x, charxy(x, y)->symbol);
+        io_map_addch(y, x, charxy(x, y)->symbol);
       } else if (hardnessxy(x, y) == 255) {
-        mvaddch(y + 1, x, '*');
+        io_map_addch(y, x, '*');
       } else {
-        mvaddch(y + 1, x, '0' + (d->pc_tunnel[y][x] % 10));
+        io_map_addch(y, x, '0' + (d->pc_tunnel[y][x] % 10));
       }
     }
   }
+  io_flush_frame();
   refresh();
 }
 
 void io_display_distance(dungeon *d)
 {
-  uint32_t y, x;
+  int32_t y, x;
+  dijkstra_lazy(d);
   clear();
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  io_frame_invalidate();
+  for (y = io_view[dim_y]; y < io_view[dim_y] + DUNGEON_Y; y++) {
+    for (x = io_view[dim_x]; x < io_view[dim_x] + DUNGEON_X; x++) {
       if (charxy(x, y)) {
-        mvaddch(y + 1, x, charxy(x, y)->symbol);
+        io_map_addch(y, x, charxy(x, y)->symbol);
       } else if (hardnessxy(x, y) != 0) {
-        mvaddch(y + 1, x, ' ');
+        io_map_addch(y, x, ' ');
       } else {
-        mvaddch(y + 1, x, '0' + (d->pc_distance[y][x] % 10));
+        io_map_addch(y, x, '0' + (d->pc_distance[y][x] % 10));
       }
     }
   }
+  io_flush_frame();
   refresh();
 }
 
@@ -142,25 +293,27 @@ static char hardness_to_char[] =
 
 void io_display_hardness(dungeon *d)
 {
-  uint32_t y, x;
+  int32_t y, x;
   clear();
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  io_frame_invalidate();
+  for (y = io_view[dim_y]; y < io_view[dim_y] + DUNGEON_Y; y++) {
+    for (x = io_view[dim_x]; x < io_view[dim_x] + DUNGEON_X; x++) {
       /* Maximum hardness is 255.  We have 62 values to display it, but *
        * we only want one zero value, so we need to cover [1,255] with  *
        * 61 values, which gives us a divisor of 254 / 61 = 4.164.       *
        * Generally, we want to avoid floating point math, but this is   *
        * not gameplay, so we'll make an exception here to get maximal   *
        * hardness display resolution.                                   */
-      mvaddch(y + 1, x, (d->hardness[y][x]                             ?
+      io_map_addch(y, x, (d->hardness[y][x]                             ?
                          hardness_to_char[1 + (int) ((d->hardness[y][x] /
                                                       4.2))] : ' '));
     }
   }
+  io_flush_frame();
   refresh();
 }
 
-static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
+static uint32_t io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
 {
   /* This was initially supposed to only redisplay visible monsters.  After *
    * implementing that (comparitivly simple) functionality and testing, I   *
@@ -172,21 +325,24 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
    * of this is to accelerate the rendering of multi-colored monsters, and  *
    * it is *significantly* faster than that (it eliminates flickering       *
    * artifacts), but it's still significantly slower than it could be.  I   *
-   * will revisit this in the future to add the acceleration matrix.        */
+   * will revisit this in the future to add the acceleration matrix.        *
+   * Returns how many of the monsters drawn are multicolored, which is     *
+   * whether there's any reason to call it again before the next key.      */
   pair_t pos;
   uint32_t color;
   uint32_t illuminated;
+  uint32_t animated;
 
-  for (pos[dim_y] = -PC_VISUAL_RANGE;
+  for (animated = 0, pos[dim_y] = -PC_VISUAL_RANGE;
        pos[dim_y] <= PC_VISUAL_RANGE;
        pos[dim_y]++) {
     for (pos[dim_x] = -PC_VISUAL_RANGE;
          pos[dim_x] <= PC_VISUAL_RANGE;
          pos[dim_x]++) {
       if ((d->PC->position[dim_y] + pos[dim_y] < 0) ||
-          (d->PC->position[dim_y] + pos[dim_y] >= DUNGEON_Y) ||
+          (d->PC->position[dim_y] + pos[dim_y] >= d->height) ||
           (d->PC->position[dim_x] + pos[dim_x] < 0) ||
-          (d->PC->position[dim_x] + pos[dim_x] >= DUNGEON_X)) {
+          (d->PC->position[dim_x] + pos[dim_x] >= d->width)) {
         continue;
       }
       if ((illuminated = is_illuminated(d->PC,
@@ -196,20 +352,19 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
       }
       if (cursor[dim_y] == d->PC->position[dim_y] + pos[dim_y] &&
           cursor[dim_x] == d->PC->position[dim_x] + pos[dim_x]) {
-        mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                d->PC->position[dim_x] + pos[dim_x], '*');
+        io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x], '*');
       } else if (d->character_map[d->PC->position[dim_y] + pos[dim_y]]
                                  [d->PC->position[dim_x] + pos[dim_x]] &&
-                 can_see(d, d->PC->position,
-                         d->character_map[d->PC->position[dim_y] + pos[dim_y]]
-                                         [d->PC->position[dim_x] +
-                                          pos[dim_x]]->position, 1, 0)) {
+                 pc_can_see(d->PC, d->PC->position[dim_y] + pos[dim_y],
+                            d->PC->position[dim_x] + pos[dim_x])) {
+        animated += d->character_map[d->PC->position[dim_y] + pos[dim_y]]
+                                    [d->PC->position[dim_x] +
+                                     pos[dim_x]]->color.size() > 1;
         attron(COLOR_PAIR((color = d->character_map[d->PC->position[dim_y] +
                                                     pos[dim_y]]
                                                    [d->PC->position[dim_x] +
-                                                    pos[dim_x]]->get_color())));
-        mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                d->PC->position[dim_x] + pos[dim_x],
+                                                    pos[dim_x]]->get_color(io_rng))));
+        io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x],
                 character_get_symbol(d->character_map[d->PC->position[dim_y] +
                                                       pos[dim_y]]
                                                      [d->PC->position[dim_x] +
@@ -217,17 +372,14 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
         attroff(COLOR_PAIR(color));
       } else if (d->objmap[d->PC->position[dim_y] + pos[dim_y]]
                           [d->PC->position[dim_x] + pos[dim_x]] &&
-                 (can_see(d, d->PC->position,
-                          d->objmap[d->PC->position[dim_y] + pos[dim_y]]
-                                   [d->PC->position[dim_x] +
-                                    pos[dim_x]]->get_position(), 1, 0) ||
+                 (pc_can_see(d->PC, d->PC->position[dim_y] + pos[dim_y],
+                             d->PC->position[dim_x] + pos[dim_x]) ||
                  d->objmap[d->PC->position[dim_y] + pos[dim_y]]
                           [d->PC->position[dim_x] + pos[dim_x]]->have_seen())) {
         attron(COLOR_PAIR(d->objmap[d->PC->position[dim_y] + pos[dim_y]]
                                    [d->PC->position[dim_x] +
                                     pos[dim_x]]->get_color()));
-        mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                d->PC->position[dim_x] + pos[dim_x],
+        io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x],
                 d->objmap[d->PC->position[dim_y] + pos[dim_y]]
                          [d->PC->position[dim_x] + pos[dim_x]]->get_symbol());
         attroff(COLOR_PAIR(d->objmap[d->PC->position[dim_y] + pos[dim_y]]
@@ -241,42 +393,38 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
         case ter_wall:
         case ter_wall_immutable:
         case ter_unknown:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], ' ');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x], ' ');
           break;
         case ter_floor:
         case ter_floor_room:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '.');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x], '.');
           break;
         case ter_floor_hall:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '#');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x], '#');
           break;
         case ter_debug:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '*');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x], '*');
           break;
         case ter_stairs_up:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '<');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x], '<');
           break;
         case ter_stairs_down:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '>');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x], '>');
           break;
         default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '0');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y], d->PC->position[dim_x] + pos[dim_x], '0');
         }
       }
       attroff(A_BOLD);
     }
   }
 
+  io_flush_frame();
   refresh();
+
+  return animated;
 }
 
 static int compare_monster_distance(const void *v1, const void *v2)
@@ -298,8 +446,8 @@ static character *io_nearest_visible_monster(dungeon *d)
   c = (character **) malloc(d->num_monsters * sizeof (*c));
 
   /* Get a linear list of monsters */
-  for (count = 0, y = 1; y < DUNGEON_Y - 1; y++) {
-    for (x = 1; x < DUNGEON_X - 1; x++) {
+  for (count = 0, y = 1; y < d->height - 1U; y++) {
+    for (x = 1; x < d->width - 1U; x++) {
       if (d->character_map[y][x] && d->character_map[y][x] != d->PC) {
         c[count++] = d->character_map[y][x];
       }
@@ -307,11 +455,12 @@ static character *io_nearest_visible_monster(dungeon *d)
   }
 
   /* Sort it by distance from PC */
+  dijkstra_lazy(d);
   thedungeon = d;
   qsort(c, count, sizeof (*c), compare_monster_distance);
 
   for (n = NULL, i = 0; i < count; i++) {
-    if (can_see(d, character_get_pos(d->PC), character_get_pos(c[i]), 1, 0)) {
+    if (pc_can_see(d->PC, character_get_y(c[i]), character_get_x(c[i]))) {
       n = c[i];
       break;
     }
@@ -330,11 +479,23 @@ void io_display(dungeon *d)
   character *c;
   int32_t visible_monsters;
 
-  clear();
-  for (visible_monsters = -1, pos[dim_y] = 0;
-       pos[dim_y] < DUNGEON_Y;
+  if (io_headless) {
+    return;
+  }
+
+  io_follow(d, d->PC->position);
+
+  /* The map is redrawn in place; only the lines around it are blanked. */
+  move(0, 0);
+  clrtoeol();
+  move(DUNGEON_Y + 1, 0);
+  clrtobot();
+  for (visible_monsters = -1, pos[dim_y] = io_view[dim_y];
+       pos[dim_y] < io_view[dim_y] + DUNGEON_Y;
        pos[dim_y]++) {
-    for (pos[dim_x] = 0; pos[dim_x] < DUNGEON_X; pos[dim_x]++) {
+    for (pos[dim_x] = io_view[dim_x];
+         pos[dim_x] < io_view[dim_x] + DUNGEON_X;
+         pos[dim_x]++) {
       if ((illuminated = is_illuminated(d->PC,
                                         pos[dim_y],
                                         pos[dim_x]))) {
@@ -342,14 +503,11 @@ void io_display(dungeon *d)
       }
       if (d->character_map[pos[dim_y]]
                           [pos[dim_x]] &&
-          can_see(d,
-                  character_get_pos(d->PC),
-                  character_get_pos(d->character_map[pos[dim_y]]
-                                                    [pos[dim_x]]), 1, 0)) {
+          pc_can_see(d->PC, pos[dim_y], pos[dim_x])) {
         visible_monsters++;
         attron(COLOR_PAIR((color = d->character_map[pos[dim_y]]
-                                                   [pos[dim_x]]->get_color())));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
+                                                   [pos[dim_x]]->get_color(io_rng))));
+        io_map_addch(pos[dim_y], pos[dim_x],
                 character_get_symbol(d->character_map[pos[dim_y]]
                                                      [pos[dim_x]]));
         attroff(COLOR_PAIR(color));
@@ -357,10 +515,10 @@ void io_display(dungeon *d)
                           [pos[dim_x]] &&
                  (d->objmap[pos[dim_y]]
                            [pos[dim_x]]->have_seen() ||
-                  can_see(d, character_get_pos(d->PC), pos, 1, 0))) {
+                  pc_can_see(d->PC, pos[dim_y], pos[dim_x]))) {
         attron(COLOR_PAIR(d->objmap[pos[dim_y]]
                                    [pos[dim_x]]->get_color()));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
+        io_map_addch(pos[dim_y], pos[dim_x],
                 d->objmap[pos[dim_y]]
                          [pos[dim_x]]->get_symbol());
         attroff(COLOR_PAIR(d->objmap[pos[dim_y]]
@@ -372,28 +530,28 @@ void io_display(dungeon *d)
         case ter_wall:
         case ter_wall_immutable:
         case ter_unknown:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], ' ');
+          io_map_addch(pos[dim_y], pos[dim_x], ' ');
           break;
         case ter_floor:
         case ter_floor_room:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '.');
+          io_map_addch(pos[dim_y], pos[dim_x], '.');
           break;
         case ter_floor_hall:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '#');
+          io_map_addch(pos[dim_y], pos[dim_x], '#');
           break;
         case ter_debug:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '*');
+          io_map_addch(pos[dim_y], pos[dim_x], '*');
           break;
         case ter_stairs_up:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '<');
+          io_map_addch(pos[dim_y], pos[dim_x], '<');
           break;
         case ter_stairs_down:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '>');
+          io_map_addch(pos[dim_y], pos[dim_x], '>');
           break;
         default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '0');
+          io_map_addch(pos[dim_y], pos[dim_x], '0');
         }
       }
       if (illuminated) {
@@ -401,6 +559,7 @@ void io_display(dungeon *d)
       }
     }
   }
+  io_flush_frame();
 
   mvprintw(23, 1, "PC stats HP:%4d Mana: %-4d",d->PC->hp, d->PC->mana);
   mvprintw(22, 1, "%d known %s.", visible_monsters,
@@ -428,31 +587,38 @@ void io_display(dungeon *d)
   refresh();
 }
 
-static void io_redisplay_non_terrain(dungeon *d, pair_t cursor)
+static uint32_t io_redisplay_non_terrain(dungeon *d, pair_t cursor)
 {
-  /* For the wiz-mode teleport, in order to see color-changing effects. */
+  /* For the wiz-mode teleport, in order to see color-changing effects. *
+   * Returns how many multicolored monsters it drew, as above.          */
   pair_t pos;
   uint32_t color;
   uint32_t illuminated;
+  uint32_t animated;
 
-  for (pos[dim_y] = 0; pos[dim_y] < DUNGEON_Y; pos[dim_y]++) {
-    for (pos[dim_x] = 0; pos[dim_x] < DUNGEON_X; pos[dim_x]++) {
+  for (animated = 0, pos[dim_y] = io_view[dim_y];
+       pos[dim_y] < io_view[dim_y] + DUNGEON_Y;
+       pos[dim_y]++) {
+    for (pos[dim_x] = io_view[dim_x];
+         pos[dim_x] < io_view[dim_x] + DUNGEON_X;
+         pos[dim_x]++) {
       if ((illuminated = is_illuminated(d->PC,
                                         pos[dim_y],
                                         pos[dim_x]))) {
         attron(A_BOLD);
       }
       if (cursor[dim_y] == pos[dim_y] && cursor[dim_x] == pos[dim_x]) {
-        mvaddch(pos[dim_y] + 1, pos[dim_x], '*');
+        io_map_addch(pos[dim_y], pos[dim_x], '*');
       } else if (d->character_map[pos[dim_y]][pos[dim_x]]) {
+        animated += d->character_map[pos[dim_y]][pos[dim_x]]->color.size() > 1;
         attron(COLOR_PAIR((color = d->character_map[pos[dim_y]]
-                                                   [pos[dim_x]]->get_color())));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
+                                                   [pos[dim_x]]->get_color(io_rng))));
+        io_map_addch(pos[dim_y], pos[dim_x],
                 character_get_symbol(d->character_map[pos[dim_y]][pos[dim_x]]));
         attroff(COLOR_PAIR(color));
       } else if (d->objmap[pos[dim_y]][pos[dim_x]]) {
         attron(COLOR_PAIR(d->objmap[pos[dim_y]][pos[dim_x]]->get_color()));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
+        io_map_addch(pos[dim_y], pos[dim_x],
                 d->objmap[pos[dim_y]][pos[dim_x]]->get_symbol());
         attroff(COLOR_PAIR(d->objmap[pos[dim_y]][pos[dim_x]]->get_color()));
       }
@@ -460,56 +626,102 @@ static void io_redisplay_non_terrain(dungeon *d, pair_t cursor)
     }
   }
 
+  io_flush_frame();
   refresh();
+
+  return animated;
+}
+
+/* Redraws the window with redisplay() and returns when there's a key to *
+ * read.  Between keys, nothing on the screen changes but the colors of   *
+ * multicolored monsters, so the redraw is repeated, io_animation_hz      *
+ * times a second, only while the last one drew any.  Otherwise the game  *
+ * sleeps in poll() until the player does something.                     */
+static void io_wait_input(dungeon *d, pair_t cursor,
+                          uint32_t (*redisplay)(dungeon *d, pair_t cursor))
+{
+  struct pollfd in;
+  struct timespec now, next;
+  int64_t wait;
+  int timeout;
+
+  in.fd = STDIN_FILENO;
+  in.events = POLLIN;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  for (;;) {
+    if (!redisplay(d, cursor) || !io_animation_hz) {
+      timeout = -1;
+    } else {
+      /* Frames are due at a steady rate, whatever the redraws cost. */
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      next.tv_nsec += 1000000000 / io_animation_hz;
+      next.tv_sec += next.tv_nsec / 1000000000;
+      next.tv_nsec %= 1000000000;
+      wait = ((next.tv_sec - now.tv_sec) * 1000 +
+              (next.tv_nsec - now.tv_nsec) / 1000000);
+      if (wait < 0) {
+        /* Fell behind; start over from now rather than catch up. */
+        next = now;
+        wait = 0;
+      }
+      timeout = wait;
+    }
+    if (poll(&in, 1, timeout) > 0) {
+      return;
+    }
+  }
 }
 
 void io_display_no_fog(dungeon *d)
 {
-  uint32_t y, x;
+  int32_t y, x;
   uint32_t color;
   character *c;
 
   clear();
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  io_frame_invalidate();
+  for (y = io_view[dim_y]; y < io_view[dim_y] + DUNGEON_Y; y++) {
+    for (x = io_view[dim_x]; x < io_view[dim_x] + DUNGEON_X; x++) {
       if (d->character_map[y][x]) {
-        attron(COLOR_PAIR((color = d->character_map[y][x]->get_color())));
-        mvaddch(y + 1, x, character_get_symbol(d->character_map[y][x]));
+        attron(COLOR_PAIR((color = d->character_map[y][x]->get_color(io_rng))));
+        io_map_addch(y, x, character_get_symbol(d->character_map[y][x]));
         attroff(COLOR_PAIR(color));
       } else if (d->objmap[y][x]) {
         attron(COLOR_PAIR(d->objmap[y][x]->get_color()));
-        mvaddch(y + 1, x, d->objmap[y][x]->get_symbol());
+        io_map_addch(y, x, d->objmap[y][x]->get_symbol());
         attroff(COLOR_PAIR(d->objmap[y][x]->get_color()));
       } else {
         switch (mapxy(x, y)) {
         case ter_wall:
         case ter_wall_immutable:
-          mvaddch(y + 1, x, ' ');
+          io_map_addch(y, x, ' ');
           break;
         case ter_floor:
         case ter_floor_room:
-          mvaddch(y + 1, x, '.');
+          io_map_addch(y, x, '.');
           break;
         case ter_floor_hall:
-          mvaddch(y + 1, x, '#');
+          io_map_addch(y, x, '#');
           break;
         case ter_debug:
-          mvaddch(y + 1, x, '*');
+          io_map_addch(y, x, '*');
           break;
         case ter_stairs_up:
-          mvaddch(y + 1, x, '<');
+          io_map_addch(y, x, '<');
           break;
         case ter_stairs_down:
-          mvaddch(y + 1, x, '>');
+          io_map_addch(y, x, '>');
           break;
         default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-          mvaddch(y + 1, x, '0');
+          io_map_addch(y, x, '0');
         }
       }
     }
   }
+  io_flush_frame();
 
   mvprintw(23, 1, "PC position is (%2d,%2d).",
            d->PC->position[dim_x], d->PC->position[dim_y]);
@@ -540,6 +752,7 @@ void io_display_no_fog(dungeon *d)
 
 void io_display_monster_list(dungeon *d)
 {
+  io_frame_invalidate();
   mvprintw(11, 33, " HP:    XXXXX ");
   mvprintw(12, 33, " Speed: XXXXX ");
   mvprintw(14, 27, " Hit any key to continue. ");
@@ -549,33 +762,25 @@ void io_display_monster_list(dungeon *d)
 
 uint32_t io_teleport_pc(dungeon *d)
 {
+  static const char *prompt =
+    "Choose a location.  'g' or '.' to teleport to; 'r' for random.";
   pair_t dest;
   int c;
-  fd_set readfs;
-  struct timeval tv;
 
   pc_reset_visibility(d->PC);
   io_display_no_fog(d);
 
-  mvprintw(0, 0,
-           "Choose a location.  'g' or '.' to teleport to; 'r' for random.");
+  mvprintw(0, 0, prompt);
 
   dest[dim_y] = d->PC->position[dim_y];
   dest[dim_x] = d->PC->position[dim_x];
 
-  mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+  io_map_addch(dest[dim_y], dest[dim_x], '*');
+  io_flush_frame();
   refresh();
 
   do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
-
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
-
-      io_redisplay_non_terrain(d, dest);
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+    io_wait_input(d, dest, io_redisplay_non_terrain);
     /* Can simply draw the terrain when we move the cursor away, *
      * because if it is a character or object, the refresh       *
      * function will fix it for us.                              */
@@ -583,28 +788,28 @@ uint32_t io_teleport_pc(dungeon *d)
     case ter_wall:
     case ter_wall_immutable:
     case ter_unknown:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], ' ');
+      io_map_addch(dest[dim_y], dest[dim_x], ' ');
       break;
     case ter_floor:
     case ter_floor_room:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '.');
+      io_map_addch(dest[dim_y], dest[dim_x], '.');
       break;
     case ter_floor_hall:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '#');
+      io_map_addch(dest[dim_y], dest[dim_x], '#');
       break;
     case ter_debug:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+      io_map_addch(dest[dim_y], dest[dim_x], '*');
       break;
     case ter_stairs_up:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '<');
+      io_map_addch(dest[dim_y], dest[dim_x], '<');
       break;
     case ter_stairs_down:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '>');
+      io_map_addch(dest[dim_y], dest[dim_x], '>');
       break;
     default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '0');
+      io_map_addch(dest[dim_y], dest[dim_x], '0');
     }
     switch ((c = getch())) {
     case '7':
@@ -630,38 +835,38 @@ uint32_t io_teleport_pc(dungeon *d)
       if (dest[dim_y] != 1) {
         dest[dim_y]--;
       }
-      if (dest[dim_x] != DUNGEON_X - 2) {
+      if (dest[dim_x] != d->width - 2) {
         dest[dim_x]++;
       }
       break;
     case '6':
     case 'l':
     case KEY_RIGHT:
-      if (dest[dim_x] != DUNGEON_X - 2) {
+      if (dest[dim_x] != d->width - 2) {
         dest[dim_x]++;
       }
       break;
     case '3':
     case 'n':
     case KEY_NPAGE:
-      if (dest[dim_y] != DUNGEON_Y - 2) {
+      if (dest[dim_y] != d->height - 2) {
         dest[dim_y]++;
       }
-      if (dest[dim_x] != DUNGEON_X - 2) {
+      if (dest[dim_x] != d->width - 2) {
         dest[dim_x]++;
       }
       break;
     case '2':
     case 'j':
     case KEY_DOWN:
-      if (dest[dim_y] != DUNGEON_Y - 2) {
+      if (dest[dim_y] != d->height - 2) {
         dest[dim_y]++;
       }
       break;
     case '1':
     case 'b':
     case KEY_END:
-      if (dest[dim_y] != DUNGEON_Y - 2) {
+      if (dest[dim_y] != d->height - 2) {
         dest[dim_y]++;
       }
       if (dest[dim_x] != 1) {
@@ -676,12 +881,17 @@ uint32_t io_teleport_pc(dungeon *d)
       }
       break;
     }
+    /* On a big map, the window scrolls to keep up with the cursor. */
+    if (io_follow(d, dest)) {
+      io_display_no_fog(d);
+      mvprintw(0, 0, prompt);
+    }
   } while (c != 'g' && c != '.' && c != 'r');
 
   if (c == 'r') {
     do {
-      dest[dim_x] = rand_range(1, DUNGEON_X - 2);
-      dest[dim_y] = rand_range(1, DUNGEON_Y - 2);
+      dest[dim_x] = d->rand.range(1, d->width - 2);
+      dest[dim_y] = d->rand.range(1, d->height - 2);
     } while (charpair(dest) || mappair(dest) < ter_floor);
   }
 
@@ -696,8 +906,7 @@ uint32_t io_teleport_pc(dungeon *d)
   }
 
   pc_observe_terrain(d->PC, d);
-  dijkstra(d);
-  dijkstra_tunnel(d);
+  dijkstra_invalidate(d);
 
   io_display(d);
 
@@ -786,6 +995,7 @@ static void io_list_monsters_display(dungeon *d,
 
   s = (char (*)[60]) malloc((count + 1) * sizeof (*s));
 
+  io_frame_invalidate();
   mvprintw(3, 9, " %-60s ", "");
   /* Borrow the first element of our array for this string: */
   snprintf(s[0], 60, "You know of %d monsters:", count);
@@ -847,17 +1057,17 @@ static void io_list_monsters(dungeon *d)
   c = (character **) malloc(d->num_monsters * sizeof (*c));
 
   /* Get a linear list of monsters */
-  for (count = 0, y = 1; y < DUNGEON_Y - 1; y++) {
-    for (x = 1; x < DUNGEON_X - 1; x++) {
+  for (count = 0, y = 1; y < d->height - 1U; y++) {
+    for (x = 1; x < d->width - 1U; x++) {
       if (d->character_map[y][x] && d->character_map[y][x] != d->PC &&
-          can_see(d, character_get_pos(d->PC),
-                  character_get_pos(d->character_map[y][x]), 1, 0)) {
+          pc_can_see(d->PC, y, x)) {
         c[count++] = d->character_map[y][x];
       }
     }
   }
 
   /* Sort it by distance from PC */
+  dijkstra_lazy(d);
   thedungeon = d;
   qsort(c, count, sizeof (*c), compare_monster_distance);
 
@@ -869,8 +1079,59 @@ static void io_list_monsters(dungeon *d)
   io_display(d);
 }
 
+/* Shows the last IO_MESSAGE_LOG messages over the map, the newest at the *
+ * bottom, and scrolls back through them a line or a page at a time.     */
+static void io_display_message_log(dungeon *d)
+{
+  const uint32_t rows = DUNGEON_Y - 2;
+  uint32_t count, first, offset, i;
+  int key;
+
+  count = io_message_next < IO_MESSAGE_LOG ? io_message_next : IO_MESSAGE_LOG;
+  first = io_message_next - count;
+  offset = count > rows ? count - rows : 0;
+
+  io_frame_invalidate();
+  do {
+    attron(COLOR_PAIR(COLOR_CYAN));
+    for (i = 0; i < rows; i++) {
+      mvprintw(i + 1, 0, "%-80s",
+               (offset + i < count                                      ?
+                io_message[(first + offset + i) % IO_MESSAGE_LOG] : ""));
+    }
+    attroff(COLOR_PAIR(COLOR_CYAN));
+    mvprintw(rows + 1, 0, "%-80s", "");
+    mvprintw(rows + 2, 0, "%-80s",
+             count ? "Arrows or page keys to scroll, escape to continue." :
+                     "No messages yet.  Hit escape to continue.");
+    refresh();
+    switch (key = getch()) {
+    case KEY_UP:
+      if (offset) {
+        offset--;
+      }
+      break;
+    case KEY_DOWN:
+      if (offset + rows < count) {
+        offset++;
+      }
+      break;
+    case KEY_PPAGE:
+      offset = offset > rows ? offset - rows : 0;
+      break;
+    case KEY_NPAGE:
+      offset = (offset + rows + rows < count ? offset + rows :
+                count > rows                 ? count - rows  : 0);
+      break;
+    }
+  } while (key != 27 /* escape */);
+
+  io_display(d);
+}
+
 void io_display_ch(dungeon *d)
 {
+  io_frame_invalidate();
   mvprintw(11, 33, " HP:    %5d ", d->PC->hp);
   mvprintw(12, 33, " Speed: %5d ", d->PC->speed);
   mvprintw(14, 27, " Hit any key to continue. ");
@@ -895,6 +1156,7 @@ uint32_t io_wear_eq(dungeon *d)
   uint32_t i, key;
   char s[61];
 
+  io_frame_invalidate();
   for (i = 0; i < MAX_INVENTORY; i++) {
     /* We'll write 12 lines, 10 of inventory, 1 blank, and 1 prompt. *
      * We'll limit width to 60 characters, so very long object names *
@@ -950,6 +1212,7 @@ void io_display_in(dungeon *d)
   uint32_t i;
   char s[61];
 
+  io_frame_invalidate();
   for (i = 0; i < MAX_INVENTORY; i++) {
     io_object_to_string(d->PC->in[i], s, 61);
     mvprintw(i + 7, 10, " %c) %-55s ", '0' + i, s);
@@ -970,6 +1233,7 @@ uint32_t io_remove_eq(dungeon *d)
   uint32_t i, key;
   char s[61], t[61];
 
+  io_frame_invalidate();
   for (i = 0; i < num_eq_slots; i++) {
     sprintf(s, "[%s]", eq_slot_name[i]);
     io_object_to_string(d->PC->eq[i], t, 61);
@@ -1020,6 +1284,7 @@ void io_display_eq(dungeon *d)
   uint32_t i;
   char s[61], t[61];
 
+  io_frame_invalidate();
   for (i = 0; i < num_eq_slots; i++) {
     sprintf(s, "[%s]", eq_slot_name[i]);
     io_object_to_string(d->PC->eq[i], t, 61);
@@ -1040,6 +1305,7 @@ uint32_t io_drop_in(dungeon *d)
   uint32_t i, key;
   char s[61];
 
+  io_frame_invalidate();
   for (i = 0; i < MAX_INVENTORY; i++) {
       mvprintw(i + 6, 10, " %c) %-55s ", '0' + i,
                d->PC->in[i] ? d->PC->in[i]->get_name() : "");
@@ -1103,6 +1369,7 @@ static uint32_t io_display_obj_info(object *o)
     }
   }
 
+  io_frame_invalidate();
   for (i = 0; i < n + 4; i++) {
     mvprintw(i, 0, s);
   }
@@ -1126,6 +1393,7 @@ static uint32_t io_inspect_in(dungeon *d)
   uint32_t i, key;
   char s[61];
 
+  io_frame_invalidate();
   for (i = 0; i < MAX_INVENTORY; i++) {
     io_object_to_string(d->PC->in[i], s, 61);
     mvprintw(i + 6, 10, " %c) %-55s ", '0' + i,
@@ -1180,8 +1448,6 @@ static uint32_t io_inspect_monster(dungeon *d)
   uint32_t n;
   pair_t dest, tmp;
   int c;
-  fd_set readfs;
-  struct timeval tv;
   char s[80];
   const char *p;
 
@@ -1192,19 +1458,12 @@ static uint32_t io_inspect_monster(dungeon *d)
   dest[dim_y] = d->PC->position[dim_y];
   dest[dim_x] = d->PC->position[dim_x];
 
-  mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+  io_map_addch(dest[dim_y], dest[dim_x], '*');
+  io_flush_frame();
   refresh();
 
   do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
-
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
-
-      io_redisplay_visible_monsters(d, dest);
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+    io_wait_input(d, dest, io_redisplay_visible_monsters);
     /* Can simply draw the terrain when we move the cursor away, *
      * because if it is a character or object, the refresh       *
      * function will fix it for us.                              */
@@ -1212,28 +1471,28 @@ static uint32_t io_inspect_monster(dungeon *d)
     case ter_wall:
     case ter_wall_immutable:
     case ter_unknown:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], ' ');
+      io_map_addch(dest[dim_y], dest[dim_x], ' ');
       break;
     case ter_floor:
     case ter_floor_room:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '.');
+      io_map_addch(dest[dim_y], dest[dim_x], '.');
       break;
     case ter_floor_hall:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '#');
+      io_map_addch(dest[dim_y], dest[dim_x], '#');
       break;
     case ter_debug:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+      io_map_addch(dest[dim_y], dest[dim_x], '*');
       break;
     case ter_stairs_up:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '<');
+      io_map_addch(dest[dim_y], dest[dim_x], '<');
       break;
     case ter_stairs_down:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '>');
+      io_map_addch(dest[dim_y], dest[dim_x], '>');
       break;
     default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '0');
+      io_map_addch(dest[dim_y], dest[dim_x], '0');
     }
     tmp[dim_y] = dest[dim_y];
     tmp[dim_x] = dest[dim_x];
@@ -1244,11 +1503,11 @@ static uint32_t io_inspect_monster(dungeon *d)
       tmp[dim_y]--;
       tmp[dim_x]--;
       if (dest[dim_y] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]--;
       }
       if (dest[dim_x] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]--;
       }
       break;
@@ -1257,7 +1516,7 @@ static uint32_t io_inspect_monster(dungeon *d)
     case KEY_UP:
       tmp[dim_y]--;
       if (dest[dim_y] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]--;
       }
       break;
@@ -1267,11 +1526,11 @@ static uint32_t io_inspect_monster(dungeon *d)
       tmp[dim_y]--;
       tmp[dim_x]++;
       if (dest[dim_y] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]--;
       }
-      if (dest[dim_x] != DUNGEON_X - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_x] != d->width - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]++;
       }
       break;
@@ -1279,8 +1538,8 @@ static uint32_t io_inspect_monster(dungeon *d)
     case 'l':
     case KEY_RIGHT:
       tmp[dim_x]++;
-      if (dest[dim_x] != DUNGEON_X - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_x] != d->width - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]++;
       }
       break;
@@ -1289,12 +1548,12 @@ static uint32_t io_inspect_monster(dungeon *d)
     case KEY_NPAGE:
       tmp[dim_y]++;
       tmp[dim_x]++;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_y] != d->height - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]++;
       }
-      if (dest[dim_x] != DUNGEON_X - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_x] != d->width - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]++;
       }
       break;
@@ -1302,8 +1561,8 @@ static uint32_t io_inspect_monster(dungeon *d)
     case 'j':
     case KEY_DOWN:
       tmp[dim_y]++;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_y] != d->height - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]++;
       }
       break;
@@ -1312,12 +1571,12 @@ static uint32_t io_inspect_monster(dungeon *d)
     case KEY_END:
       tmp[dim_y]++;
       tmp[dim_x]--;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_y] != d->height - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]++;
       }
       if (dest[dim_x] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]--;
       }
       break;
@@ -1326,7 +1585,7 @@ static uint32_t io_inspect_monster(dungeon *d)
     case KEY_LEFT:
       tmp[dim_x]--;
       if (dest[dim_x] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]--;
       }
       break;
@@ -1354,6 +1613,7 @@ static uint32_t io_inspect_monster(dungeon *d)
     }
   }
 
+  io_frame_invalidate();
   mvprintw(0, 0, s);
   mvprintw(2, 0, ((npc *) charpair(dest))->description);
   mvprintw(n + 4, 0, "Hit any key to continue. ");
@@ -1372,6 +1632,7 @@ static uint32_t io_inspect_eq(dungeon *d)
   uint32_t i, key;
   char s[61], t[61];
 
+  io_frame_invalidate();
   for (i = 0; i < num_eq_slots; i++) {
     sprintf(s, "[%s]", eq_slot_name[i]);
     io_object_to_string(d->PC->eq[i], t, 61);
@@ -1425,6 +1686,7 @@ uint32_t io_expunge_in(dungeon *d)
   uint32_t i, key;
   char s[61];
 
+  io_frame_invalidate();
   for (i = 0; i < MAX_INVENTORY; i++) {
     /* We'll write 12 lines, 10 of inventory, 1 blank, and 1 prompt. *
      * We'll limit width to 60 characters, so very long object names *
@@ -1556,8 +1818,6 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
   }
   pair_t dest, tmp;
   int c;
-  fd_set readfs;
-  struct timeval tv;
 
   io_display(d);
 
@@ -1566,19 +1826,12 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
   dest[dim_y] = d->PC->position[dim_y];
   dest[dim_x] = d->PC->position[dim_x];
 
-  mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+  io_map_addch(dest[dim_y], dest[dim_x], '*');
+  io_flush_frame();
   refresh();
 
   do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
-
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
-
-      io_redisplay_visible_monsters(d, dest);
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+    io_wait_input(d, dest, io_redisplay_visible_monsters);
     /* Can simply draw the terrain when we move the cursor away, *
     * because if it is a character or object, the refresh       *
     * function will fix it for us.                              */
@@ -1586,28 +1839,28 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
     case ter_wall:
     case ter_wall_immutable:
     case ter_unknown:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], ' ');
+      io_map_addch(dest[dim_y], dest[dim_x], ' ');
       break;
     case ter_floor:
     case ter_floor_room:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '.');
+      io_map_addch(dest[dim_y], dest[dim_x], '.');
       break;
     case ter_floor_hall:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '#');
+      io_map_addch(dest[dim_y], dest[dim_x], '#');
       break;
     case ter_debug:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+      io_map_addch(dest[dim_y], dest[dim_x], '*');
       break;
     case ter_stairs_up:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '<');
+      io_map_addch(dest[dim_y], dest[dim_x], '<');
       break;
     case ter_stairs_down:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '>');
+      io_map_addch(dest[dim_y], dest[dim_x], '>');
       break;
     default:
 /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '0');
+      io_map_addch(dest[dim_y], dest[dim_x], '0');
     }
     tmp[dim_y] = dest[dim_y];
     tmp[dim_x] = dest[dim_x];
@@ -1618,11 +1871,11 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
       tmp[dim_y]--;
       tmp[dim_x]--;
       if (dest[dim_y] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]--;
       }
       if (dest[dim_x] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]--;
       }
       break;
@@ -1631,7 +1884,7 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
     case KEY_UP:
       tmp[dim_y]--;
       if (dest[dim_y] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]--;
       }
       break;
@@ -1641,11 +1894,11 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
       tmp[dim_y]--;
       tmp[dim_x]++;
       if (dest[dim_y] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]--;
       }
-      if (dest[dim_x] != DUNGEON_X - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_x] != d->width - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]++;
       }
       break;
@@ -1653,8 +1906,8 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
     case 'l':
     case KEY_RIGHT:
       tmp[dim_x]++;
-      if (dest[dim_x] != DUNGEON_X - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_x] != d->width - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]++;
       }
       break;
@@ -1663,12 +1916,12 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
     case KEY_NPAGE:
       tmp[dim_y]++;
       tmp[dim_x]++;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_y] != d->height - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]++;
       }
-      if (dest[dim_x] != DUNGEON_X - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_x] != d->width - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]++;
       }
       break;
@@ -1676,8 +1929,8 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
     case 'j':
     case KEY_DOWN:
       tmp[dim_y]++;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_y] != d->height - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]++;
       }
       break;
@@ -1686,12 +1939,12 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
     case KEY_END:
       tmp[dim_y]++;
       tmp[dim_x]--;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_y] != d->height - 2 &&
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_y]++;
       }
       if (dest[dim_x] != 1 &&
-          can_see(d, d->PC->position, tmp, 1, 0)) {
+          pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]--;
       }
       break;
@@ -1699,7 +1952,7 @@ void ranged_attack(dungeon *d, int re_target, int bomb) {
     case 'h':
     case KEY_LEFT:
       tmp[dim_x]--;
-      if (dest[dim_x] != 1 && can_see(d, d->PC->position, tmp, 1, 0)) {
+      if (dest[dim_x] != 1 && pc_can_see(d->PC, tmp[dim_y], tmp[dim_x])) {
         dest[dim_x]--;
       }
       break;
@@ -1768,26 +2021,18 @@ void io_handle_input(dungeon *d)
 {
   uint32_t fail_code;
   int key;
-  fd_set readfs;
-  struct timeval tv;
   uint32_t fog_off = 0;
-  pair_t tmp = { DUNGEON_X, DUNGEON_Y };
-
-  do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
+  pair_t tmp = { -1, -1 };
 
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
+  if (io_headless) {
+    pc_autopilot(d);
+    return;
+  }
 
-      if (fog_off) {
-        /* Out-of-bounds cursor will not be rendered. */
-        io_redisplay_non_terrain(d, tmp);
-      } else {
-        io_redisplay_visible_monsters(d, tmp);
-      }
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+  do {
+    /* Out-of-bounds cursor will not be rendered. */
+    io_wait_input(d, tmp, (fog_off ? io_redisplay_non_terrain :
+                                     io_redisplay_visible_monsters));
     fog_off = 0;
     switch (key = getch()) {
     case 'r':
@@ -1855,6 +2100,17 @@ void io_handle_input(dungeon *d)
       d->quit = 1;
       fail_code = 0;
       break;
+    case 'S':
+      /* Checkpoint the game to the default save file; --load resumes *
+       * it.  The PC hasn't moved yet this turn, so mark it to go     *
+       * first, as on a new level.  Doesn't take a turn.              */
+      d->is_new = 1;
+      io_queue_message(write_game(d, NULL) ? "Couldn't save the game." :
+                                             "Game saved.");
+      d->is_new = 0;
+      io_display(d);
+      fail_code = 1;
+      break;
     case 'T':
       /* New command.  Display the distances for tunnelers.             */
       io_display_tunnel(d);
@@ -1913,6 +2169,10 @@ void io_handle_input(dungeon *d)
       io_display_ch(d);
       fail_code = 1;
       break;
+    case 'M':
+      io_display_message_log(d);
+      fail_code = 1;
+      break;
     case 'I':
       io_inspect_in(d);
       fail_code = 1;
@@ -1,13 +1,31 @@
 #ifndef IO_H
 # define IO_H
 
+# include <stdint.h>
 
 class dungeon;
 
+/* Multicolored monsters on screen change color this many times a      *
+ * second, and only while there are some; otherwise the game sleeps    *
+ * until a key is pressed.  0 holds them still.  Override the default  *
+ * at build time with -DDEFAULT_ANIMATION_HZ=N, or at run time with    *
+ * the --animate switch.                                               */
+# ifndef DEFAULT_ANIMATION_HZ
+#  define DEFAULT_ANIMATION_HZ 8
+# endif
+# define MAX_ANIMATION_HZ     1000
+
 void io_init_terminal(void);
+void io_init_headless(void);
 void io_reset_terminal(void);
+void io_set_animation(uint32_t hz);
 void io_display(dungeon *d);
 void io_handle_input(dungeon *d);
 void io_queue_message(const char *format, ...);
 
+/* Headless games write their messages, tagged with the seed set by *
+ * io_log_game() on the same thread, to file, if it opens.            */
+int io_open_log(const char *file);
+void io_log_game(uint64_t seed);
+
 #endif
@@ -0,0 +1,168 @@
+#include <cstdlib>
+#include <pthread.h>
+
+#include "los.h"
+#include "dungeon.h"
+#include "pc.h"
+
+const char *los_engine_name[num_los_engines] = {
+  "bresenham",
+  "table",
+};
+
+/* Every line the longer of the two visual ranges can need.  The PC's *
+ * lines are the same as the first few cells of the monsters', so one *
+ * table serves both.                                                 */
+#define LOS_RANGE (PC_VISUAL_RANGE > NPC_VISUAL_RANGE ? \
+                   PC_VISUAL_RANGE : NPC_VISUAL_RANGE)
+#define LOS_SIDE  (2 * LOS_RANGE + 1)
+
+typedef struct los_step {
+  int8_t x, y;
+} los_step_t;
+
+/* The line to offset (x, y) from the voyeur is ray[y + LOS_RANGE]   *
+ * [x + LOS_RANGE]: length cells starting at step[start], the voyeur *
+ * first and the exhibitionist last.                                 */
+typedef struct los_ray {
+  uint16_t start;
+  uint16_t length;
+} los_ray_t;
+
+static los_ray_t los_ray[LOS_SIDE][LOS_SIDE];
+static los_step_t los_step[LOS_SIDE * LOS_SIDE * (LOS_RANGE + 1)];
+static pthread_once_t los_once = PTHREAD_ONCE_INIT;
+
+/* Records the cells of the line from (0, 0) to (x, y) at step, exactly *
+ * as can_see() draws them, and returns how many there are.            */
+static uint16_t los_trace(int16_t x, int16_t y, los_step_t *step)
+{
+  pair_t first, del, f;
+  int16_t a, b, c, i;
+  uint16_t n;
+
+  first[dim_x] = first[dim_y] = 0;
+  del[dim_x] = abs(x);
+  f[dim_x] = x > 0 ? 1 : -1;
+  del[dim_y] = abs(y);
+  f[dim_y] = y > 0 ? 1 : -1;
+
+  n = 0;
+  if (del[dim_x] > del[dim_y]) {
+    a = del[dim_y] + del[dim_y];
+    c = a - del[dim_x];
+    b = c - del[dim_x];
+    for (i = 0; i <= del[dim_x]; i++) {
+      step[n].x = first[dim_x];
+      step[n++].y = first[dim_y];
+      first[dim_x] += f[dim_x];
+      if (c < 0) {
+        c += a;
+      } else {
+        c += b;
+        first[dim_y] += f[dim_y];
+      }
+    }
+  } else {
+    a = del[dim_x] + del[dim_x];
+    c = a - del[dim_y];
+    b = c - del[dim_y];
+    for (i = 0; i <= del[dim_y]; i++) {
+      step[n].x = first[dim_x];
+      step[n++].y = first[dim_y];
+      first[dim_y] += f[dim_y];
+      if (c < 0) {
+        c += a;
+      } else {
+        c += b;
+        first[dim_x] += f[dim_x];
+      }
+    }
+  }
+
+  return n;
+}
+
+static void los_init()
+{
+  int16_t x, y;
+  uint16_t n;
+
+  for (n = 0, y = -LOS_RANGE; y <= LOS_RANGE; y++) {
+    for (x = -LOS_RANGE; x <= LOS_RANGE; x++) {
+      los_ray[y + LOS_RANGE][x + LOS_RANGE].start = n;
+      n += (los_ray[y + LOS_RANGE][x + LOS_RANGE].length =
+            los_trace(x, y, los_step + n));
+    }
+  }
+}
+
+/* The PC learns every cell up to and including the first wall, and  *
+ * everything on the far end whether or not it's a wall.  The PC's    *
+ * grids are the same size as the map, so one flat index serves all. */
+static uint32_t los_learn(dungeon *d, pair_t voyeur,
+                          const los_step_t *step, uint16_t length)
+{
+  const terrain_type *map;
+  terrain_type *known;
+  uint8_t *visible;
+  object **objects;
+  int32_t origin, width, cell;
+  uint16_t i;
+
+  width = d->map.width();
+  origin = voyeur[dim_y] * width + voyeur[dim_x];
+  map = d->map.data();
+  objects = d->objmap.data();
+  known = d->PC->known_terrain.data();
+  visible = d->PC->visible.data();
+
+  for (i = 0; i < length; i++) {
+    cell = origin + step[i].y * width + step[i].x;
+    known[cell] = map[cell];
+    visible[cell] = 1;
+    pc_see_object(d->PC, objects[cell]);
+    if ((map[cell] < ter_floor) && i && (i != length - 1)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+uint32_t los_can_see(dungeon *d, pair_t voyeur, pair_t exhibitionist,
+                     int is_pc, int learn)
+{
+  const los_step_t *step;
+  const terrain_type *origin;
+  const los_ray_t *ray;
+  int16_t x, y, visual_range;
+  uint32_t blocked, width;
+  uint16_t i;
+
+  pthread_once(&los_once, los_init);
+
+  visual_range = is_pc ? PC_VISUAL_RANGE : NPC_VISUAL_RANGE;
+
+  x = exhibitionist[dim_x] - voyeur[dim_x];
+  y = exhibitionist[dim_y] - voyeur[dim_y];
+  if (abs(x) > visual_range || abs(y) > visual_range) {
+    return 0;
+  }
+
+  ray = &los_ray[y + LOS_RANGE][x + LOS_RANGE];
+  step = los_step + ray->start;
+
+  if (learn) {
+    return los_learn(d, voyeur, step, ray->length);
+  }
+
+  /* Only the cells between the ends can block the line. */
+  origin = &mappair(voyeur);
+  width = d->map.width();
+  for (blocked = 0, i = 1; i + 1 < ray->length; i++) {
+    blocked |= origin[step[i].y * (int32_t) width + step[i].x] < ter_floor;
+  }
+
+  return !blocked;
+}
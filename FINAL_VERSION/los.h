@@ -0,0 +1,36 @@
+#ifndef LOS_H
+# define LOS_H
+
+# include <stdint.h>
+
+# include "dims.h"
+
+class dungeon;
+
+/* Two engines answer can_see().  The bresenham engine is the original: *
+ * it draws the line from scratch on every query.  The table engine     *
+ * draws every line within NPC_VISUAL_RANGE once, at the first query,   *
+ * keeps the cells of each as a list of offsets from the voyeur, and    *
+ * tests a line by or'ing together the wall tests of its cells, with no *
+ * branch until the end.  The lines are the same Bresenham lines, so    *
+ * the answers--asymmetry and all--and the terrain learned are exactly  *
+ * the same.  Override the default at build time with                   *
+ * -DDEFAULT_LOS_ENGINE=los_engine_bresenham, or at run time with the   *
+ * --los switch.                                                        */
+typedef enum los_engine {
+  los_engine_bresenham,
+  los_engine_table,
+  num_los_engines
+} los_engine_t;
+
+# ifndef DEFAULT_LOS_ENGINE
+#  define DEFAULT_LOS_ENGINE los_engine_table
+# endif
+
+extern const char *los_engine_name[num_los_engines];
+
+/* can_see() for the table engine; see character.h. */
+uint32_t los_can_see(dungeon *d, pair_t voyeur, pair_t exhibitionist,
+                     int is_pc, int learn);
+
+#endif
@@ -89,18 +89,18 @@ void do_combat(dungeon *d, character *atk, character *def)
   };
   if (character_is_alive(def)) {
     if (atk != d->PC) {
-      damage = atk->damage->roll();
+      damage = atk->damage->roll(d->rand);
       io_queue_message("%s%s %s your %s for %d.", is_unique(atk) ? "" : "The ",
-                       atk->name, attacks[rand() % (sizeof (attacks) /
+                       atk->name, attacks[d->rand.next() % (sizeof (attacks) /
                                                     sizeof (attacks[0]))],
-                       organs[rand() % (sizeof (organs) /
+                       organs[d->rand.next() % (sizeof (organs) /
                                         sizeof (organs[0]))], damage);
     } else {
       for (i = damage = 0; i < num_eq_slots; i++) {
         if (i == eq_slot_weapon && !d->PC->eq[i]) {
-          damage += atk->damage->roll();
+          damage += atk->damage->roll(d->rand);
         } else if (d->PC->eq[i]) {
-          damage += d->PC->eq[i]->roll_dice();
+          damage += d->PC->eq[i]->roll_dice(d->rand);
         }
       }
       io_queue_message("You hit %s%s for %d.", is_unique(def) ? "" : "the ",
@@ -111,7 +111,7 @@ void do_combat(dungeon *d, character *atk, character *def)
       if (atk != d->PC) {
         io_queue_message("You die.");
         io_queue_message("As %s%s eats your %s,", is_unique(atk) ? "" : "the ",
-                         atk->name, organs[rand() % (sizeof (organs) /
+                         atk->name, organs[d->rand.next() % (sizeof (organs) /
                                                      sizeof (organs[0]))]);
         io_queue_message("   ...you wonder if there is an afterlife.");
         /* Queue an empty message, otherwise the game will not pause for *
@@ -187,12 +187,14 @@ void move_character(dungeon *d, character *c, pair_t next)
        * instead select a random square from the 8 surrounding    *
        * the target cell.  Keep doing it until either we swap or  *
        * find an empty one for the displacement.                  */
-      for (s = rand() % 9, found_cell = i = 0;
+      for (s = d->rand.next() % 9, found_cell = i = 0;
            i < 9 && !found_cell; i++) {
         displacement[dim_y] = next[dim_y] + order[s % 9][dim_y];
         displacement[dim_x] = next[dim_x] + order[s % 9][dim_x];
         if (((npc *) charpair(next))->characteristics & NPC_PASS_WALL) {
-          if (!charpair(displacement) ||
+          /* Not even these can be shoved into the outer wall. */
+          if ((!charpair(displacement) &&
+               (mappair(displacement) != ter_wall_immutable)) ||
               (charpair(displacement) == c)) {
             found_cell = 1;
           }
@@ -264,26 +266,19 @@ void do_moves(dungeon *d)
    * worrying about deleting the PC.                                       */
 
   if (pc_is_alive(d)) {
-    /* The PC always goes first one a tie, so we don't use new_event().  *
-     * We generate one manually so that we can set the PC sequence       *
-     * number to zero.                                                   */
-    e = (event *) malloc(sizeof (*e));
-    e->type = event_character_turn;
-    /* Hack: New dungeons are marked.  Unmark and ensure PC goes at d->time, *
-     * otherwise, monsters get a turn before the PC.                         */
-    if (d->is_new) {
-      d->is_new = 0;
-      e->time = d->time;
-    } else {
-      e->time = d->time + (1000 / d->PC->speed);
-    }
+    /* The PC always goes first one a tie, so we override the sequence *
+     * number new_event() gives us with zero.                          *
+     * Hack: New dungeons are marked.  Unmark and ensure PC goes at    *
+     * d->time, otherwise, monsters get a turn before the PC.          */
+    e = new_event(d, event_character_turn, d->PC,
+                  d->is_new ? 0 : (1000 / d->PC->speed));
+    d->is_new = 0;
     e->sequence = 0;
-    e->c = d->PC;
-    heap_insert(&d->events, e);
+    eventq_insert(&d->events, e);
   }
 
   while (pc_is_alive(d) &&
-         (e = (event *) heap_remove_min(&d->events)) &&
+         (e = eventq_remove_min(&d->events)) &&
          ((e->type != event_character_turn) || (e->c != d->PC))) {
     d->time = e->time;
     if (e->type == event_character_turn) {
@@ -294,7 +289,7 @@ void do_moves(dungeon *d)
         d->character_map[c->position[dim_y]][c->position[dim_x]] = NULL;
       }
       if (c != d->PC) {
-        event_delete(e);
+        event_delete(d, e);
       }
       continue;
     }
@@ -302,9 +297,13 @@ void do_moves(dungeon *d)
     npc_next_pos(d, (npc *) c, next);
     move_character(d, (npc *) c, next);
 
-    heap_insert(&d->events, update_event(d, e, 1000 / c->speed));
+    eventq_insert(&d->events, update_event(d, e, 1000 / c->speed));
   }
 
+  /* Tunnelers may have opened up the PC's view since its last turn. */
+  if (d->PC) {
+    pc_update_sight(d->PC, d);
+  }
   io_display(d);
   if (pc_is_alive(d) && e->c == d->PC) {
     c = e->c;
@@ -313,7 +312,7 @@ void do_moves(dungeon *d)
      * we are outside of this function, the PC event has to get deleted *
      * and recreated every time we leave and re-enter this function.    */
     e->c = NULL;
-    event_delete(e);
+    event_delete(d, e);
     io_handle_input(d);
   }
 }
@@ -322,11 +321,11 @@ void dir_nearest_wall(dungeon *d, character *c, pair_t dir)
 {
   dir[dim_x] = dir[dim_y] = 0;
 
-  if (c->position[dim_x] != 1 && c->position[dim_x] != DUNGEON_X - 2) {
-    dir[dim_x] = (c->position[dim_x] > DUNGEON_X - c->position[dim_x] ? 1 : -1);
+  if (c->position[dim_x] != 1 && c->position[dim_x] != d->width - 2) {
+    dir[dim_x] = (c->position[dim_x] > d->width - c->position[dim_x] ? 1 : -1);
   }
-  if (c->position[dim_y] != 1 && c->position[dim_y] != DUNGEON_Y - 2) {
-    dir[dim_y] = (c->position[dim_y] > DUNGEON_Y - c->position[dim_y] ? 1 : -1);
+  if (c->position[dim_y] != 1 && c->position[dim_y] != d->height - 2) {
+    dir[dim_y] = (c->position[dim_y] > d->height - c->position[dim_y] ? 1 : -1);
   }
 }
 
@@ -453,13 +452,12 @@ uint32_t move_pc(dungeon *d, uint32_t dir)
 
   if ((dir != '>') && (dir != '<') && (mappair(next) >= ter_floor)) {
     move_character(d, d->PC, next);
-    dijkstra(d);
-    dijkstra_tunnel(d);
+    dijkstra_invalidate(d);
     d->PC->pick_up(d);
 
     return 0;
   } else if (mappair(next) < ter_floor) {
-    io_queue_message(wallmsg[rand() % (sizeof (wallmsg) /
+    io_queue_message(wallmsg[d->rand.next() % (sizeof (wallmsg) /
                                        sizeof (wallmsg[0]))]);
     io_display(d);
   }
@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
+#include <algorithm>
 
 #include "utils.h"
 #include "npc.h"
@@ -9,34 +11,75 @@
 #include "path.h"
 #include "event.h"
 #include "pc.h"
+#include "save.h"
 
-static uint32_t max_monster_cells(dungeon *d)
+/* Collects the open cells a monster may start on: room cells first, then *
+ * everything else walkable, which is where the monsters spill once the   *
+ * rooms are full.  The PC's room is left empty, as it always was.  Cells *
+ * are stored as y * width + x.                                          */
+static void monster_cells(dungeon *d, std::vector<uint32_t> &room,
+                          std::vector<uint32_t> &hall)
 {
+  pair_t p;
+  room_t *r;
   uint32_t i;
-  uint32_t sum;
 
-  for (i = sum = 0; i < d->num_rooms; i++) {
-    if (!pc_in_room(d, i)) {
-      sum += d->rooms[i].size[dim_y] * d->rooms[i].size[dim_x];
+  room.clear();
+  hall.clear();
+
+  for (r = NULL, i = 0; i < d->num_rooms; i++) {
+    if (pc_in_room(d, i)) {
+      r = d->rooms + i;
     }
   }
 
-  return sum;
+  for (p[dim_y] = 1; p[dim_y] < d->height - 1; p[dim_y]++) {
+    for (p[dim_x] = 1; p[dim_x] < d->width - 1; p[dim_x]++) {
+      if (mappair(p) < ter_floor || charpair(p)) {
+        continue;
+      }
+      if (r                                                    &&
+          p[dim_x] >= r->position[dim_x]                       &&
+          p[dim_x] < r->position[dim_x] + r->size[dim_x]       &&
+          p[dim_y] >= r->position[dim_y]                       &&
+          p[dim_y] < r->position[dim_y] + r->size[dim_y]) {
+        continue;
+      }
+      if (mappair(p) == ter_floor_room) {
+        room.push_back(p[dim_y] * d->width + p[dim_x]);
+      } else {
+        hall.push_back(p[dim_y] * d->width + p[dim_x]);
+      }
+    }
+  }
 }
 
+/* Each monster takes a cell drawn uniformly from those left (a partial *
+ * Fisher-Yates shuffle), so placement is linear in the size of the map *
+ * and the monster count, however crowded the dungeon gets.             */
 void gen_monsters(dungeon *d)
 {
-  uint32_t i;
-  uint32_t c;
+  std::vector<uint32_t> room, hall;
+  uint32_t i, j, k;
+  pair_t p;
+
+  monster_cells(d, room, hall);
 
-  if (d->max_monsters < (c = max_monster_cells(d))) {
+  if (d->max_monsters < room.size() + hall.size()) {
     d->num_monsters = d->max_monsters;
   } else {
-    d->num_monsters = c;
+    d->num_monsters = room.size() + hall.size();
   }
 
   for (i = 0; i < d->num_monsters; i++) {
-    monster_description::generate_monster(d);
+    std::vector<uint32_t> &v = i < room.size() ? room : hall;
+
+    k = i < room.size() ? i : i - room.size();
+    j = d->rand.range(k, v.size() - 1);
+    std::swap(v[k], v[j]);
+    p[dim_y] = v[k] / d->width;
+    p[dim_x] = v[k] % d->width;
+    monster_description::generate_monster(d, p);
   }
 }
 
@@ -51,7 +94,7 @@ void npc_next_pos_rand_tunnel(dungeon *d, npc *c, pair_t next)
   do {
     n[dim_y] = next[dim_y];
     n[dim_x] = next[dim_x];
-    r.i = rand();
+    r.i = d->rand.next();
     if (r.a[0] > 85 /* 255 / 3 */) {
       if (r.a[0] & 1) {
         n[dim_y]--;
@@ -74,14 +117,14 @@ void npc_next_pos_rand_tunnel(dungeon *d, npc *c, pair_t next)
       mappair(n) = ter_floor_hall;
 
       /* Update distance maps because map has changed. */
-      dijkstra(d);
-      dijkstra_tunnel(d);
+      dijkstra_repair(d, n);
     }
 
     next[dim_x] = n[dim_x];
     next[dim_y] = n[dim_y];
   } else {
     hardnesspair(n) -= 85;
+    dijkstra_repair(d, n);
   }
 }
 
@@ -96,7 +139,7 @@ void npc_next_pos_rand(dungeon *d, npc *c, pair_t next)
   do {
     n[dim_y] = next[dim_y];
     n[dim_x] = next[dim_x];
-    r.i = rand();
+    r.i = d->rand.next();
     if (r.a[0] > 85 /* 255 / 3 */) {
       if (r.a[0] & 1) {
         n[dim_y]--;
@@ -128,7 +171,7 @@ void npc_next_pos_rand_pass(dungeon *d, character *c, pair_t next)
   do {
     n[dim_y] = next[dim_y];
     n[dim_x] = next[dim_x];
-    r.i = rand();
+    r.i = d->rand.next();
     if (r.a[0] > 85 /* 255 / 3 */) {
       if (r.a[0] & 1) {
         n[dim_y]--;
@@ -200,14 +243,14 @@ void npc_next_pos_line_of_sight_tunnel(dungeon *d, npc *c, pair_t next)
       mappair(dir) = ter_floor_hall;
 
       /* Update distance maps because map has changed. */
-      dijkstra(d);
-      dijkstra_tunnel(d);
+      dijkstra_repair(d, dir);
     }
 
     next[dim_x] = dir[dim_x];
     next[dim_y] = dir[dim_y];
   } else {
     hardnesspair(dir) -= 85;
+    dijkstra_repair(d, dir);
   }
 }
 
@@ -215,8 +258,9 @@ void npc_next_pos_gradient(dungeon *d, npc *c, pair_t next)
 {
   /* Handles both tunneling and non-tunneling versions */
   pair_t min_next;
-  uint16_t min_cost;
+  uint32_t min_cost;
   if (c->characteristics & NPC_TUNNEL) {
+    dijkstra_tunnel_lazy(d);
     min_cost = (d->pc_tunnel[next[dim_y] - 1][next[dim_x]] +
                 (d->hardness[next[dim_y] - 1][next[dim_x]] / 85));
     min_next[dim_x] = next[dim_x];
@@ -276,16 +320,17 @@ void npc_next_pos_gradient(dungeon *d, npc *c, pair_t next)
         mappair(min_next) = ter_floor_hall;
 
         /* Update distance maps because map has changed. */
-        dijkstra(d);
-        dijkstra_tunnel(d);
+        dijkstra_repair(d, min_next);
       }
 
       next[dim_x] = min_next[dim_x];
       next[dim_y] = min_next[dim_y];
     } else {
       hardnesspair(min_next) -= 85;
+      dijkstra_repair(d, min_next);
     }
   } else {
+    dijkstra_lazy(d);
     /* Make monsters prefer cardinal directions */
     if (d->pc_distance[next[dim_y] - 1][next[dim_x]    ] <
         d->pc_distance[next[dim_y]][next[dim_x]]) {
@@ -501,7 +546,7 @@ static void npc_next_pos_17(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_18(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart; not telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_10(d, c, next);
@@ -511,7 +556,7 @@ static void npc_next_pos_18(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_19(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart; not telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_11(d, c, next);
@@ -521,7 +566,7 @@ static void npc_next_pos_19(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1a(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart;     telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_12(d, c, next);
@@ -531,7 +576,7 @@ static void npc_next_pos_1a(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1b(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart;     telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_13(d, c, next);
@@ -541,7 +586,7 @@ static void npc_next_pos_1b(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1c(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart; not telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_14(d, c, next);
@@ -551,7 +596,7 @@ static void npc_next_pos_1c(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1d(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart; not telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_15(d, c, next);
@@ -561,7 +606,7 @@ static void npc_next_pos_1d(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1e(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart;     telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_16(d, c, next);
@@ -571,7 +616,7 @@ static void npc_next_pos_1e(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1f(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart;     telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_17(d, c, next);
@@ -620,7 +665,7 @@ void (*npc_move_func[])(dungeon *d, npc *c, pair_t next) = {
 static void npc_next_pos_erratic(dungeon *d, npc *c, pair_t next)
 {
   /*                                               erratic */
-  if (rand() & 1) {
+  if (d->rand.next() & 1) {
     npc_next_pos_rand(d, c, next);
   } else {
     npc_move_func[c->characteristics & 0x00000007](d, c, next);
@@ -640,32 +685,19 @@ uint32_t dungeon_has_npcs(dungeon *d)
   return d->num_monsters;
 }
 
-npc::npc(dungeon *d, monster_description &m) : md(m)
+npc::npc(dungeon *d, monster_description &m, pair_t p) : md(m)
 {
-  pair_t p;
-  uint32_t room;
   uint32_t i;
 
   symbol = m.symbol;
   color = m.color;
-  i = 0;
-  do {
-    room = rand_range(1, d->num_rooms - 1);
-    p[dim_y] = rand_range(d->rooms[room].position[dim_y],
-                          (d->rooms[room].position[dim_y] +
-                           d->rooms[room].size[dim_y] - 1));
-    p[dim_x] = rand_range(d->rooms[room].position[dim_x],
-                          (d->rooms[room].position[dim_x] +
-                           d->rooms[room].size[dim_x] - 1));
-    i++;
-  } while (d->character_map[p[dim_y]][p[dim_x]]);
   pc_last_known_position[dim_y] = p[dim_y];
   pc_last_known_position[dim_x] = p[dim_x];
   position[dim_y] = p[dim_y];
   position[dim_x] = p[dim_x];
   d->character_map[p[dim_y]][p[dim_x]] = this;
-  speed = m.speed.roll();
-  hp = m.hitpoints.roll();
+  speed = m.speed.roll(d->rand);
+  hp = m.hitpoints.roll(d->rand);
   damage = &m.damage;
   alive = 1;
   sequence_number = ++d->character_sequence_number;
@@ -679,6 +711,32 @@ npc::npc(dungeon *d, monster_description &m) : md(m)
   m.birth();
 }
 
+npc::npc(monster_description &m, const character_record &r) : md(m)
+{
+  uint32_t i;
+
+  symbol = m.symbol;
+  color = m.color;
+  position[dim_x] = le16toh(r.position[dim_x]);
+  position[dim_y] = le16toh(r.position[dim_y]);
+  pc_last_known_position[dim_x] = le16toh(r.pc_last_known_position[dim_x]);
+  pc_last_known_position[dim_y] = le16toh(r.pc_last_known_position[dim_y]);
+  speed = le32toh(r.speed);
+  hp = le32toh(r.hp);
+  poisonDamage = le32toh(r.poison_damage);
+  damage = &m.damage;
+  alive = r.alive;
+  sequence_number = le32toh(r.sequence_number);
+  characteristics = le32toh(r.characteristics);
+  have_seen_pc = r.have_seen_pc;
+  name = m.name.c_str();
+  description = (const char *) m.description.c_str();
+  for (i = 0; i < num_kill_types; i++) {
+    kills[i] = le32toh(r.kills[i]);
+  }
+  m.birth();
+}
+
 npc::~npc()
 {
   if (alive) {
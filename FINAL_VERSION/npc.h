@@ -45,12 +45,15 @@
 # define is_boss(character) has_characteristic(character, BOSS)
 
 class monster_description;
+struct character_record;
 
 typedef uint32_t npc_characteristics_t;
 
 class npc : public character {
  public:
-  npc(dungeon *d, monster_description &m);
+  npc(dungeon *d, monster_description &m, pair_t p);
+  /* Restores a checkpointed monster, without placing it; see save.h. */
+  npc(monster_description &m, const character_record &r);
   ~npc();
   npc_characteristics_t characteristics;
   uint32_t have_seen_pc;
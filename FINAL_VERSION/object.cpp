@@ -4,20 +4,21 @@
 #include "object.h"
 #include "dungeon.h"
 #include "utils.h"
+#include "save.h"
 
-object::object(object_description &o, pair_t p, object *next) :
+object::object(dungeon *d, object_description &o, pair_t p, object *next) :
   name(o.get_name()),
   description(o.get_description()),
   type(o.get_type()),
   color(o.get_color()),
   damage(o.get_damage()),
-  hit(o.get_hit().roll()),
-  dodge(o.get_dodge().roll()),
-  defence(o.get_defence().roll()),
-  weight(o.get_weight().roll()),
-  speed(o.get_speed().roll()),
-  attribute(o.get_attribute().roll()),
-  value(o.get_value().roll()),
+  hit(o.get_hit().roll(d->rand)),
+  dodge(o.get_dodge().roll(d->rand)),
+  defence(o.get_defence().roll(d->rand)),
+  weight(o.get_weight().roll(d->rand)),
+  speed(o.get_speed().roll(d->rand)),
+  attribute(o.get_attribute().roll(d->rand)),
+  value(o.get_value().roll(d->rand)),
   seen(false),
   next(next),
   od(o)
@@ -28,6 +29,45 @@ object::object(object_description &o, pair_t p, object *next) :
   od.generate();
 }
 
+object::object(object_description &o, const object_record &r) :
+  name(o.get_name()),
+  description(o.get_description()),
+  type(o.get_type()),
+  color(o.get_color()),
+  damage(o.get_damage()),
+  hit(le32toh(r.hit)),
+  dodge(le32toh(r.dodge)),
+  defence(le32toh(r.defence)),
+  weight(le32toh(r.weight)),
+  speed(le32toh(r.speed)),
+  attribute(le32toh(r.attribute)),
+  value(le32toh(r.value)),
+  seen(r.seen),
+  next(NULL),
+  od(o)
+{
+  position[dim_x] = le16toh(r.position[dim_x]);
+  position[dim_y] = le16toh(r.position[dim_y]);
+
+  od.generate();
+}
+
+/* Fills in everything but the location, which only the owner knows. */
+void object::save(dungeon *d, object_record &r)
+{
+  r.description = htole32(&od - d->object_descriptions.data());
+  r.seen = seen;
+  r.position[dim_x] = htole16(position[dim_x]);
+  r.position[dim_y] = htole16(position[dim_y]);
+  r.hit = htole32(hit);
+  r.dodge = htole32(dodge);
+  r.defence = htole32(defence);
+  r.weight = htole32(weight);
+  r.speed = htole32(speed);
+  r.attribute = htole32(attribute);
+  r.value = htole32(value);
+}
+
 object::~object()
 {
   od.destroy();
@@ -45,20 +85,20 @@ void gen_object(dungeon *d)
   int i;
 
   do {
-    i = rand_range(0, v.size() - 1);
-  } while (!v[i].can_be_generated() || !v[i].pass_rarity_roll());
+    i = d->rand.range(0, v.size() - 1);
+  } while (!v[i].can_be_generated() || !v[i].pass_rarity_roll(d->rand));
   
-  room = rand_range(0, d->num_rooms - 1);
+  room = d->rand.range(0, d->num_rooms - 1);
   do {
-    p[dim_y] = rand_range(d->rooms[room].position[dim_y],
+    p[dim_y] = d->rand.range(d->rooms[room].position[dim_y],
                           (d->rooms[room].position[dim_y] +
                            d->rooms[room].size[dim_y] - 1));
-    p[dim_x] = rand_range(d->rooms[room].position[dim_x],
+    p[dim_x] = d->rand.range(d->rooms[room].position[dim_x],
                           (d->rooms[room].position[dim_x] +
                            d->rooms[room].size[dim_x] - 1));
   } while (mappair(p) > ter_stairs);
 
-  o = new object(v[i], p, d->objmap[p[dim_y]][p[dim_x]]);
+  o = new object(d, v[i], p, d->objmap[p[dim_y]][p[dim_x]]);
 
   d->objmap[p[dim_y]][p[dim_x]] = o;
   
@@ -68,7 +108,7 @@ void gen_objects(dungeon *d)
 {
   uint32_t i;
 
-  memset(d->objmap, 0, sizeof (d->objmap));
+  d->objmap.fill(NULL);
 
   for (i = 0; i < d->max_objects; i++) {
     gen_object(d);
@@ -97,17 +137,17 @@ int32_t object::get_speed()
   return speed;
 }
 
-int32_t object::roll_dice()
+int32_t object::roll_dice(rng &r)
 {
-  return damage.roll();
+  return damage.roll(r);
 }
 
 void destroy_objects(dungeon *d)
 {
   uint32_t y, x;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       if (d->objmap[y][x]) {
         delete d->objmap[y][x];
         d->objmap[y][x] = 0;
@@ -6,6 +6,8 @@
 # include "descriptions.h"
 # include "dims.h"
 
+struct object_record;
+
 class object {
  private:
   const std::string &name;
@@ -19,7 +21,10 @@ class object {
   object *next;
   object_description &od;
  public:
-  object(object_description &o, pair_t p, object *next);
+  object(dungeon *d, object_description &o, pair_t p, object *next);
+  /* Checkpoints; see save.h.  Neither touches the dungeon's rng. */
+  object(object_description &o, const object_record &r);
+  void save(dungeon *d, object_record &r);
   ~object();
   inline int32_t get_damage_base() const
   {
@@ -37,7 +42,7 @@ class object {
   uint32_t get_color();
   const char *get_name();
   int32_t get_speed();
-  int32_t roll_dice();
+  int32_t roll_dice(rng &r);
   int32_t get_type();
   bool have_seen() { return seen; }
   void has_been_seen() { seen = true; }
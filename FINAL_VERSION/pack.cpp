@@ -0,0 +1,257 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pack.h"
+
+int pack_name(const char *file, std::string *path, int64_t *level)
+{
+  const char *colon, *c;
+  size_t len, ext;
+
+  ext = strlen(PACK_EXTENSION);
+
+  *level = -1;
+  len = strlen(file);
+  if ((colon = strrchr(file, ':')) && colon[1]) {
+    for (c = colon + 1; *c >= '0' && *c <= '9'; c++)
+      ;
+    if (!*c) {
+      len = colon - file;
+      *level = strtoll(colon + 1, NULL, 10);
+    }
+  }
+
+  if (len < ext || strncmp(file + len - ext, PACK_EXTENSION, ext)) {
+    *level = -1;
+    return 0;
+  }
+
+  path->assign(file, len);
+
+  return 1;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+  uint32_t be32;
+
+  memcpy(&be32, p, sizeof (be32));
+
+  return be32toh(be32);
+}
+
+static uint64_t get_be64(const uint8_t *p)
+{
+  uint64_t be64;
+
+  memcpy(&be64, p, sizeof (be64));
+
+  return be64toh(be64);
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+  v = htobe32(v);
+  memcpy(p, &v, sizeof (v));
+}
+
+static void put_be64(uint8_t *p, uint64_t v)
+{
+  v = htobe64(v);
+  memcpy(p, &v, sizeof (v));
+}
+
+/* Checks the header at h against a file of size bytes, and returns the *
+ * offset of the index and the level count.  The file may run past the  *
+ * index, if an append was cut short.                                   */
+static int check_header(const uint8_t *h, uint64_t size,
+                        uint64_t *index, uint32_t *count)
+{
+  if (memcmp(h, PACK_SEMANTIC, sizeof (PACK_SEMANTIC) - 1) ||
+      get_be32(h + sizeof (PACK_SEMANTIC) - 1) != PACK_VERSION) {
+    return 1;
+  }
+  *count = get_be32(h + sizeof (PACK_SEMANTIC) - 1 + 4);
+  *index = get_be64(h + sizeof (PACK_SEMANTIC) - 1 + 8);
+
+  return (*index < PACK_HEADER_SIZE ||
+          *index + 8ULL * *count > size);
+}
+
+void pack_open(pack_t *p, const char *file)
+{
+  struct stat buf;
+  uint64_t index;
+  void *image;
+  int fd;
+
+  if ((fd = open(file, O_RDONLY)) < 0) {
+    perror(file);
+    exit(-1);
+  }
+  if (fstat(fd, &buf)) {
+    perror(file);
+    exit(-1);
+  }
+  if (buf.st_size < (off_t) PACK_HEADER_SIZE) {
+    fprintf(stderr, "%s is not an RLG327 pack file.\n", file);
+    exit(-1);
+  }
+  if ((image = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE,
+                    fd, 0)) == MAP_FAILED) {
+    perror("mmap");
+    exit(-1);
+  }
+  close(fd);
+
+  p->image = (const uint8_t *) image;
+  p->size = buf.st_size;
+  if (check_header(p->image, p->size, &index, &p->count)) {
+    fprintf(stderr, "%s is not an RLG327 pack file.\n", file);
+    exit(-1);
+  }
+  p->index = p->image + index;
+}
+
+const uint8_t *pack_level(const pack_t *p, uint32_t n, uint32_t *size)
+{
+  uint64_t offset, end;
+
+  if (n >= p->count) {
+    fprintf(stderr, "There is no level %u in a pack of %u levels.\n",
+            n, p->count);
+    exit(-1);
+  }
+
+  /* Every level has to fit between the header and the index. */
+  end = p->index - p->image;
+  offset = get_be64(p->index + 8ULL * n);
+  if (offset < PACK_HEADER_SIZE || offset + 20 > end ||
+      offset + (*size = get_be32(p->image + offset + 16)) > end) {
+    fprintf(stderr, "Level %u of the pack is corrupt.\n", n);
+    exit(-1);
+  }
+
+  return p->image + offset;
+}
+
+void pack_close(pack_t *p)
+{
+  munmap((void *) p->image, p->size);
+  p->image = p->index = NULL;
+  p->size = p->count = 0;
+}
+
+static int pwrite_all(int fd, const uint8_t *p, size_t size, uint64_t offset)
+{
+  ssize_t n;
+
+  for (; size; p += n, size -= n, offset += n) {
+    if ((n = pwrite(fd, p, size, offset)) < 0) {
+      if (errno == EINTR) {
+        n = 0;
+        continue;
+      }
+      perror("pack");
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int pack_writer_open(pack_writer_t *w, const char *file)
+{
+  uint8_t h[PACK_HEADER_SIZE];
+  std::vector<uint8_t> index;
+  struct stat buf;
+  uint32_t count, i;
+
+  if ((w->fd = open(file, O_RDWR | O_CREAT, 0666)) < 0) {
+    perror(file);
+    return 1;
+  }
+  if (fstat(w->fd, &buf)) {
+    perror(file);
+    close(w->fd);
+    return 1;
+  }
+
+  w->index.clear();
+  w->end = PACK_HEADER_SIZE;
+  if (!buf.st_size) {
+    return 0;
+  }
+
+  if (buf.st_size < (off_t) PACK_HEADER_SIZE                  ||
+      pread(w->fd, h, sizeof (h), 0) != (ssize_t) sizeof (h) ||
+      check_header(h, buf.st_size, &w->end, &count)) {
+    fprintf(stderr, "%s is not an RLG327 pack file.\n", file);
+    close(w->fd);
+    return 1;
+  }
+
+  index.resize(8ULL * count);
+  if (pread(w->fd, index.data(), index.size(), w->end) !=
+      (ssize_t) index.size()) {
+    perror(file);
+    close(w->fd);
+    return 1;
+  }
+  w->index.resize(count);
+  for (i = 0; i < count; i++) {
+    w->index[i] = get_be64(index.data() + 8ULL * i);
+  }
+  /* Until the header moves, readers still need the old index. */
+  w->end += index.size();
+
+  return 0;
+}
+
+int pack_append(pack_writer_t *w, const uint8_t *level, size_t size)
+{
+  if (pwrite_all(w->fd, level, size, w->end)) {
+    return 1;
+  }
+  w->index.push_back(w->end);
+  w->end += size;
+
+  return 0;
+}
+
+int pack_writer_close(pack_writer_t *w)
+{
+  std::vector<uint8_t> index(8ULL * w->index.size());
+  uint8_t h[PACK_HEADER_SIZE];
+  uint32_t i;
+  int failed;
+
+  for (i = 0; i < w->index.size(); i++) {
+    put_be64(index.data() + 8ULL * i, w->index[i]);
+  }
+
+  memcpy(h, PACK_SEMANTIC, sizeof (PACK_SEMANTIC) - 1);
+  put_be32(h + sizeof (PACK_SEMANTIC) - 1, PACK_VERSION);
+  put_be32(h + sizeof (PACK_SEMANTIC) - 1 + 4, w->index.size());
+  put_be64(h + sizeof (PACK_SEMANTIC) - 1 + 8, w->end);
+
+  /* The levels and the new index have to be on disk before the header *
+   * points at them.                                                    */
+  failed = (pwrite_all(w->fd, index.data(), index.size(), w->end) ||
+            ftruncate(w->fd, w->end + index.size())                ||
+            fdatasync(w->fd)                                       ||
+            pwrite_all(w->fd, h, sizeof (h), 0));
+  if (close(w->fd)) {
+    failed = 1;
+  }
+  w->fd = -1;
+
+  return failed;
+}
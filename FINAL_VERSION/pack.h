@@ -0,0 +1,63 @@
+#ifndef PACK_H
+# define PACK_H
+
+# include <stdint.h>
+# include <stddef.h>
+# include <string>
+# include <vector>
+
+/* A corpus pack holds any number of levels in one file, so that tools   *
+ * can map it once and go straight to level n, rather than opening and   *
+ * stat()ing a file per level.  Big-endian, like the save header:        *
+ *                                                                       *
+ *   0-11   the semantic, PACK_SEMANTIC                                  *
+ *   12-15  the version, PACK_VERSION                                    *
+ *   16-19  the number of levels                                         *
+ *   20-27  the offset of the index                                      *
+ *                                                                       *
+ * then the levels, each a complete save file of any version (so each   *
+ * carries its own size), then the index: an 8-byte offset per level.    *
+ * Appending leaves the old index where it is and writes the new levels  *
+ * and a new index after it, then the header, so a pack cut short by a   *
+ * crash still reads as it was before.  Each append leaves the index it  *
+ * replaced behind, unused, ahead of its levels.  Anything past the end  *
+ * of the index is ignored.                                              */
+# define PACK_SEMANTIC      "RLGPCK-" TERM
+# define PACK_VERSION       0U
+# define PACK_HEADER_SIZE   (sizeof (PACK_SEMANTIC) - 1 + 16)
+/* Names ending with this are packs, to --load and --save. */
+# define PACK_EXTENSION     ".rlgpack"
+
+typedef struct pack {
+  const uint8_t *image;
+  size_t size;
+  uint32_t count;
+  const uint8_t *index;
+} pack_t;
+
+typedef struct pack_writer {
+  int fd;
+  /* Where the next level goes, which is where the index will go. */
+  uint64_t end;
+  std::vector<uint64_t> index;
+} pack_writer_t;
+
+/* Splits "<name>.rlgpack:<n>" into the file name and level n.  Returns *
+ * 0 if file isn't a pack at all; level is -1 if there's no ":<n>".     */
+int pack_name(const char *file, std::string *path, int64_t *level);
+
+/* Maps a pack for reading.  Exits if it isn't one, as the save file *
+ * readers do.                                                       */
+void pack_open(pack_t *p, const char *file);
+/* Level n, a save file image of *size bytes, for read_dungeon_image(). */
+const uint8_t *pack_level(const pack_t *p, uint32_t n, uint32_t *size);
+void pack_close(pack_t *p);
+
+/* Opens a pack for appending, creating it if it doesn't exist.  Levels *
+ * only become visible to readers on pack_writer_close().  These return *
+ * non-zero on failure.                                                 */
+int pack_writer_open(pack_writer_t *w, const char *file);
+int pack_append(pack_writer_t *w, const uint8_t *level, size_t size);
+int pack_writer_close(pack_writer_t *w);
+
+#endif
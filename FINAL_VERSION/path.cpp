@@ -1,10 +1,18 @@
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <vector>
 
 #include "path.h"
 #include "dungeon.h"
 #include "utils.h"
 #include "pc.h"
 
+const char *path_engine_name[num_path_engines] = {
+  "heap",
+  "bucket"
+};
+
 /* Ugly hack: There is no way to pass a pointer to the dungeon into the *
  * heap's comparitor funtion without modifying the heap.  Copying the   *
  * pc_distance array is a possible solution, but that doubles the       *
@@ -12,14 +20,31 @@
  * Instead, make a global pointer to the dungeon in this file,          *
  * initialize it in dijkstra, and use it in the comparitor to get to    *
  * pc_distance.  Otherwise, pretend it doesn't exist, because it really *
- * is ugly.                                                             */
-static dungeon *thedungeon;
+ * is ugly.  It and the scratch space below are per-thread, so that     *
+ * games can run in parallel.                                           */
+static thread_local dungeon *thedungeon;
 
 typedef struct path {
   heap_node_t *hn;
-  uint8_t pos[2];
+  uint16_t pos[2];
 } path_t;
 
+/* Sizes the per-thread scratch grid to the dungeon, if it isn't already. */
+static void path_init(dungeon *d, grid<path_t> &p)
+{
+  uint32_t x, y;
+
+  if (p.width() != d->width || p.height() != d->height) {
+    p.resize(d->width, d->height, path_t());
+    for (y = 0; y < d->height; y++) {
+      for (x = 0; x < d->width; x++) {
+        p[y][x].pos[dim_y] = y;
+        p[y][x].pos[dim_x] = x;
+      }
+    }
+  }
+}
+
 static int32_t dist_cmp(const void *key, const void *with) {
   return ((int32_t) thedungeon->pc_distance[((path_t *) key)->pos[dim_y]]
                                            [((path_t *) key)->pos[dim_x]] -
@@ -34,38 +59,26 @@ static int32_t tunnel_cmp(const void *key, const void *with) {
                                          [((path_t *) with)->pos[dim_x]]);
 }
 
-void dijkstra(dungeon *d)
+void dijkstra_heap(dungeon *d)
 {
   /* Currently assumes that monsters only move on floors.  Will *
    * need to be modified for tunneling and pass-wall monsters.  */
 
   heap_t h;
   uint32_t x, y;
-  static path_t p[DUNGEON_Y][DUNGEON_X], *c;
-  static uint32_t initialized = 0;
-
-  if (!initialized) {
-    initialized = 1;
-    thedungeon = d;
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
-      }
-    }
-  }
+  static thread_local grid<path_t> p;
+  path_t *c;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      d->pc_distance[y][x] = 255;
-    }
-  }
+  thedungeon = d;
+  path_init(d, p);
+
+  d->pc_distance.fill(DISTANCE_INFINITY);
   d->pc_distance[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
 
   heap_init(&h, dist_cmp, NULL);
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       if (mapxy(x, y) >= ter_floor) {
         p[y][x].hn = heap_insert(&h, &p[y][x]);
       }
@@ -147,7 +160,7 @@ void dijkstra(dungeon *d)
 #define tunnel_movement_cost(x, y)                      \
   ((d->hardness[y][x] / 85) + 1)
 
-void dijkstra_tunnel(dungeon *d)
+void dijkstra_tunnel_heap(dungeon *d)
 {
   /* Currently assumes that monsters only move on floors.  Will *
    * need to be modified for tunneling and pass-wall monsters.  */
@@ -155,31 +168,19 @@ void dijkstra_tunnel(dungeon *d)
   heap_t h;
   uint32_t x, y;
   uint32_t size;
-  static path_t p[DUNGEON_Y][DUNGEON_X], *c;
-  static uint32_t initialized = 0;
-
-  if (!initialized) {
-    initialized = 1;
-    thedungeon = d;
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
-      }
-    }
-  }
+  static thread_local grid<path_t> p;
+  path_t *c;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      d->pc_tunnel[y][x] = 255;
-    }
-  }
+  thedungeon = d;
+  path_init(d, p);
+
+  d->pc_tunnel.fill(DISTANCE_INFINITY);
   d->pc_tunnel[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
 
   heap_init(&h, tunnel_cmp, NULL);
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       if (mapxy(x, y) != ter_wall_immutable) {
         p[y][x].hn = heap_insert(&h, &p[y][x]);
       }
@@ -275,3 +276,240 @@ void dijkstra_tunnel(dungeon *d)
   }
   heap_delete(&h);
 }
+
+/* Dial's algorithm.  Every edge costs between 1 and MAX_EDGE_COST, so *
+ * while we are draining the bucket for distance n, every live entry   *
+ * has a distance in [n, n + MAX_EDGE_COST].  A circular array of      *
+ * MAX_EDGE_COST + 1 buckets therefore suffices, each of which holds   *
+ * entries of exactly one distance at a time.  A cell can only be      *
+ * queued once per distance (relaxation is strictly decreasing), so    *
+ * each bucket needs at most one slot per cell.  Stale entries (cells  *
+ * since lowered into an earlier bucket) are skipped when popped,      *
+ * which is cheaper than unlinking them on every decrease.             */
+#define MAX_EDGE_COST ((254 / HARDNESS_PER_TURN) + 1)
+#define NUM_BUCKETS   (MAX_EDGE_COST + 1)
+
+typedef struct bucket_queue {
+  std::vector<uint32_t> cell[NUM_BUCKETS];
+} bucket_queue_t;
+
+static thread_local bucket_queue_t bucket_q;
+
+/* Flat-index steps from a cell to its eight neighbors. */
+static inline void neighbor_offsets(dungeon *d, int32_t offset[8])
+{
+  int32_t w = d->width;
+
+  offset[0] = -w - 1;
+  offset[1] = -w;
+  offset[2] = -w + 1;
+  offset[3] = -1;
+  offset[4] = 1;
+  offset[5] = w - 1;
+  offset[6] = w;
+  offset[7] = w + 1;
+}
+
+static inline void bucket_push(uint32_t c, uint32_t dist)
+{
+  bucket_q.cell[dist % NUM_BUCKETS].push_back(c);
+}
+
+/* Drains the bucket queue starting from the bucket for distance cur, *
+ * which must be the smallest distance queued.                        */
+static void dial_drain(dungeon *d, distance_t *dist, uint32_t tunnel,
+                       uint32_t cur)
+{
+  const terrain_type *map = d->map.data();
+  const uint8_t *hardness = d->hardness.data();
+  int32_t neighbor_offset[8];
+  uint32_t pending, b, i, j, c, n, nd;
+
+  neighbor_offsets(d, neighbor_offset);
+
+  for (pending = b = 0; b < NUM_BUCKETS; b++) {
+    pending += bucket_q.cell[b].size();
+  }
+
+  /* Distances saturate at DISTANCE_INFINITY, so there is never anything *
+   * to do past that, exactly as with the heap engine.                   */
+  for (; pending && cur < DISTANCE_INFINITY; cur++) {
+    b = cur % NUM_BUCKETS;
+    for (i = 0; i < bucket_q.cell[b].size(); i++) {
+      c = bucket_q.cell[b][i];
+      if (dist[c] != cur) {
+        continue;
+      }
+      nd = cur + (tunnel ? (hardness[c] / HARDNESS_PER_TURN) + 1 : 1);
+      for (j = 0; j < 8; j++) {
+        n = c + neighbor_offset[j];
+        if ((tunnel ? map[n] != ter_wall_immutable : map[n] >= ter_floor) &&
+            dist[n] > nd) {
+          dist[n] = nd;
+          bucket_push(n, nd);
+          pending++;
+        }
+      }
+    }
+    pending -= bucket_q.cell[b].size();
+    bucket_q.cell[b].clear();
+  }
+
+  for (b = 0; b < NUM_BUCKETS; b++) {
+    bucket_q.cell[b].clear();
+  }
+}
+
+static void dial(dungeon *d, grid<distance_t> &dist, uint32_t tunnel)
+{
+  uint32_t c;
+
+  dist.fill(DISTANCE_INFINITY);
+
+  c = d->PC->position[dim_y] * d->width + d->PC->position[dim_x];
+  dist.data()[c] = 0;
+  bucket_push(c, 0);
+  dial_drain(d, dist.data(), tunnel, 0);
+}
+
+void dijkstra_bucket(dungeon *d)
+{
+  dial(d, d->pc_distance, 0);
+}
+
+void dijkstra_tunnel_bucket(dungeon *d)
+{
+  dial(d, d->pc_tunnel, 1);
+}
+
+void dijkstra(dungeon *d)
+{
+  if (d->path_engine == path_engine_heap) {
+    dijkstra_heap(d);
+  } else {
+    dijkstra_bucket(d);
+  }
+  d->pc_distance_dirty = 0;
+  d->pc_distance_stats.rebuilt++;
+}
+
+void dijkstra_tunnel(dungeon *d)
+{
+  if (d->path_engine == path_engine_heap) {
+    dijkstra_tunnel_heap(d);
+  } else {
+    dijkstra_tunnel_bucket(d);
+  }
+  d->pc_tunnel_dirty = 0;
+  d->pc_tunnel_stats.rebuilt++;
+}
+
+void dijkstra_invalidate(dungeon *d)
+{
+  d->pc_distance_dirty = d->pc_tunnel_dirty = 1;
+  d->pc_distance_stats.requested++;
+  d->pc_tunnel_stats.requested++;
+}
+
+void dijkstra_lazy(dungeon *d)
+{
+  if (d->pc_distance_dirty) {
+    dijkstra(d);
+  }
+}
+
+void dijkstra_tunnel_lazy(dungeon *d)
+{
+  if (d->pc_tunnel_dirty) {
+    dijkstra_tunnel(d);
+  }
+}
+
+void path_print_stats(dungeon *d, FILE *f)
+{
+  fprintf(f, "Distance maps (%s): walking rebuilt %u of %u times "
+          "(%u avoided, %u repaired),\n"
+          "                      tunneling rebuilt %u of %u times "
+          "(%u avoided, %u repaired).\n",
+          path_engine_name[d->path_engine],
+          d->pc_distance_stats.rebuilt, d->pc_distance_stats.requested,
+          (d->pc_distance_stats.requested - d->pc_distance_stats.rebuilt),
+          d->pc_distance_stats.repaired,
+          d->pc_tunnel_stats.rebuilt, d->pc_tunnel_stats.requested,
+          (d->pc_tunnel_stats.requested - d->pc_tunnel_stats.rebuilt),
+          d->pc_tunnel_stats.repaired);
+}
+
+#ifndef VERIFY_PATH_REPAIR
+# define VERIFY_PATH_REPAIR 0
+#endif
+
+/* Called after the cell at p got cheaper to enter or to leave: a wall *
+ * was carved into a corridor, or merely softened by a tunneler.       *
+ * Both changes can only shorten paths, so rather than rebuilding the  *
+ * maps we lower distances outward from p, touching only the cells     *
+ * whose distance actually changes.  The maps must be up to date with  *
+ * respect to everything but this one change.                          */
+void dijkstra_repair(dungeon *d, pair_t p)
+{
+  int32_t neighbor_offset[8];
+  distance_t *dist;
+  uint32_t c, j, nd;
+#if VERIFY_PATH_REPAIR
+  grid<distance_t> distance, tunnel;
+#endif
+
+  neighbor_offsets(d, neighbor_offset);
+  c = p[dim_y] * d->width + p[dim_x];
+
+  /* The eager scheme rebuilt both maps when a wall was carved, but not *
+   * when one was merely softened.  A stale map will be rebuilt from    *
+   * scratch when next read anyway.                                     */
+  if (mappair(p) >= ter_floor) {
+    d->pc_distance_stats.requested++;
+    d->pc_tunnel_stats.requested++;
+  }
+
+  /* A new floor cell is entered from its neighbors at one step each. */
+  dist = d->pc_distance.data();
+  if (!d->pc_distance_dirty && mappair(p) >= ter_floor) {
+    d->pc_distance_stats.repaired++;
+    for (nd = dist[c], j = 0; j < 8; j++) {
+      if ((d->map.data()[c + neighbor_offset[j]] >= ter_floor) &&
+          dist[c + neighbor_offset[j]] + 1U < nd) {
+        nd = dist[c + neighbor_offset[j]] + 1U;
+      }
+    }
+    if (nd < dist[c]) {
+      dist[c] = nd;
+      bucket_push(c, nd);
+      dial_drain(d, dist, 0, nd);
+    }
+  }
+
+  /* Tunneling cost is charged on the way out of a cell, so p's own *
+   * distance is unchanged, but its neighbors may now be closer.    */
+  dist = d->pc_tunnel.data();
+  if (!d->pc_tunnel_dirty && dist[c] < DISTANCE_INFINITY) {
+    d->pc_tunnel_stats.repaired++;
+    bucket_push(c, dist[c]);
+    dial_drain(d, dist, 1, dist[c]);
+  }
+
+#if VERIFY_PATH_REPAIR
+  distance.resize(d->width, d->height, 0);
+  tunnel.resize(d->width, d->height, 0);
+  dial(d, distance, 0);
+  dial(d, tunnel, 1);
+  if ((!d->pc_distance_dirty &&
+       memcmp(distance.data(), d->pc_distance.data(),
+              distance.size() * sizeof (distance_t))) ||
+      (!d->pc_tunnel_dirty &&
+       memcmp(tunnel.data(), d->pc_tunnel.data(),
+              tunnel.size() * sizeof (distance_t)))) {
+    fprintf(stderr, "Distance map repair at (%d, %d) diverged from a full "
+            "recompute.\n", p[dim_x], p[dim_y]);
+    abort();
+  }
+#endif
+}
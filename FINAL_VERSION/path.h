@@ -3,9 +3,63 @@
 
 # define HARDNESS_PER_TURN 85
 
+# include <stdint.h>
+# include <stdio.h>
+
+# include "dims.h"
+
+/* Distances saturate at DISTANCE_INFINITY, which also means unreachable. *
+ * A tunneling step costs at most 3, so 16 bits hold any tunneling        *
+ * distance on the largest map; walking paths too long for them are      *
+ * treated as unreachable, as those over 254 were when these were bytes. */
+typedef uint16_t distance_t;
+# define DISTANCE_INFINITY UINT16_MAX
+
+/* Two interchangable engines compute the PC distance maps.  The heap   *
+ * engine is the original Dijkstra on the Fibonacci heap; the bucket    *
+ * engine is Dial's algorithm, which exploits the tiny integer weights. *
+ * Both produce identical maps.  Override the default at build time     *
+ * with -DDEFAULT_PATH_ENGINE=path_engine_heap, or at run time with the *
+ * --path switch.                                                       */
+typedef enum path_engine {
+  path_engine_heap,
+  path_engine_bucket,
+  num_path_engines
+} path_engine_t;
+
+# ifndef DEFAULT_PATH_ENGINE
+#  define DEFAULT_PATH_ENGINE path_engine_bucket
+# endif
+
+extern const char *path_engine_name[num_path_engines];
+
+/* The distance maps are built lazily.  Anything that moves the PC or  *
+ * changes the terrain wholesale calls dijkstra_invalidate(); anything *
+ * that reads a map calls dijkstra_lazy() or dijkstra_tunnel_lazy()    *
+ * first, which rebuild only if the map is stale.  Most PC turns end   *
+ * up rebuilding at most one map, and only if a smart monster asks.    *
+ * "requested" counts the rebuilds the old eager scheme would have     *
+ * done: on every dijkstra_invalidate() and every carved wall, though *
+ * not on walls that were only softened.  requested - rebuilt is the   *
+ * number avoided.                                                     */
+typedef struct path_stats {
+  uint32_t requested;
+  uint32_t rebuilt;
+  uint32_t repaired;
+} path_stats_t;
+
 class dungeon;
 
 void dijkstra(dungeon *d);
 void dijkstra_tunnel(dungeon *d);
+void dijkstra_heap(dungeon *d);
+void dijkstra_tunnel_heap(dungeon *d);
+void dijkstra_bucket(dungeon *d);
+void dijkstra_tunnel_bucket(dungeon *d);
+void dijkstra_repair(dungeon *d, pair_t p);
+void dijkstra_invalidate(dungeon *d);
+void dijkstra_lazy(dungeon *d);
+void dijkstra_tunnel_lazy(dungeon *d);
+void path_print_stats(dungeon *d, FILE *f);
 
 #endif
@@ -25,6 +25,9 @@ const char *eq_slot_name[num_eq_slots] = {
   "rh ring"
 };
 
+static dice pc_dice(0, 1, 4);
+
+/* Everything about a new PC except where it is; see config_pc(). */
 pc::pc()
 {
   uint32_t i;
@@ -37,7 +40,18 @@ pc::pc()
     in[i] = 0;
   }
 
+  symbol = '@';
+  speed = PC_SPEED;
+  alive = 1;
+  sequence_number = 0;
+  kills[kill_direct] = kills[kill_avenged] = 0;
+  color.push_back(COLOR_WHITE);
+  damage = &pc_dice;
+  name = "Isabella Garcia-Shapiro";
   hp = 1000;
+  mana = 100;
+  target[dim_x] = target[dim_y] = 0;
+  have_seen_corner = corner_count = 0;
 }
 
 pc::~pc()
@@ -66,14 +80,14 @@ uint32_t pc_is_alive(dungeon *d)
 
 void place_pc(dungeon *d)
 {
-  d->PC->position[dim_y] = rand_range(d->rooms->position[dim_y],
+  d->PC->position[dim_y] = d->rand.range(d->rooms->position[dim_y],
                                      (d->rooms->position[dim_y] +
                                       d->rooms->size[dim_y] - 1));
-  d->PC->position[dim_x] = rand_range(d->rooms->position[dim_x],
+  d->PC->position[dim_x] = d->rand.range(d->rooms->position[dim_x],
                                      (d->rooms->position[dim_x] +
                                       d->rooms->size[dim_x] - 1));
 
-  pc_init_known_terrain(d->PC);
+  pc_init_known_terrain(d->PC, d);
   pc_observe_terrain(d->PC, d);
 
   io_display(d);
@@ -81,33 +95,19 @@ void place_pc(dungeon *d)
 
 void config_pc(dungeon *d)
 {
-  static dice pc_dice(0, 1, 4);
-
   d->PC = new pc;
 
-  d->PC->symbol = '@';
-
   place_pc(d);
 
-  d->PC->speed = PC_SPEED;
-  d->PC->alive = 1;
-  d->PC->sequence_number = 0;
-  d->PC->kills[kill_direct] = d->PC->kills[kill_avenged] = 0;
-  d->PC->color.push_back(COLOR_WHITE);
-  d->PC->damage = &pc_dice;
-  d->PC->name = "Isabella Garcia-Shapiro";
-
   d->character_map[d->PC->position[dim_y]][d->PC->position[dim_x]] = d->PC;
 
-  d->PC->mana = 100;
-  dijkstra(d);
-  dijkstra_tunnel(d);
+  dijkstra_invalidate(d);
 }
 
 uint32_t pc_next_pos(dungeon *d, pair_t dir)
 {
-  static uint32_t have_seen_corner = 0;
-  static uint32_t count = 0;
+  uint32_t &have_seen_corner = d->PC->have_seen_corner;
+  uint32_t &count = d->PC->corner_count;
 
   dir[dim_y] = dir[dim_x] = 0;
 
@@ -144,20 +144,20 @@ uint32_t pc_next_pos(dungeon *d, pair_t dir)
     if (count) {
       count++;
     }
-    if (!against_wall(d, d->PC) && ((rand() & 0x111) == 0x111)) {
-      dir[dim_x] = (rand() % 3) - 1;
-      dir[dim_y] = (rand() % 3) - 1;
+    if (!against_wall(d, d->PC) && ((d->rand.next() & 0x111) == 0x111)) {
+      dir[dim_x] = (d->rand.next() % 3) - 1;
+      dir[dim_y] = (d->rand.next() % 3) - 1;
     } else {
       dir_nearest_wall(d, d->PC, dir);
     }
   }else {
     /* And after we've been there, let's head toward the center of the map. */
-    if (!against_wall(d, d->PC) && ((rand() & 0x111) == 0x111)) {
-      dir[dim_x] = (rand() % 3) - 1;
-      dir[dim_y] = (rand() % 3) - 1;
+    if (!against_wall(d, d->PC) && ((d->rand.next() & 0x111) == 0x111)) {
+      dir[dim_x] = (d->rand.next() % 3) - 1;
+      dir[dim_y] = (d->rand.next() % 3) - 1;
     } else {
-      dir[dim_x] = ((d->PC->position[dim_x] > DUNGEON_X / 2) ? -1 : 1);
-      dir[dim_y] = ((d->PC->position[dim_y] > DUNGEON_Y / 2) ? -1 : 1);
+      dir[dim_x] = ((d->PC->position[dim_x] > d->width / 2) ? -1 : 1);
+      dir[dim_y] = ((d->PC->position[dim_y] > d->height / 2) ? -1 : 1);
     }
   }
 
@@ -202,6 +202,28 @@ uint32_t pc_next_pos(dungeon *d, pair_t dir)
   return 0;
 }
 
+/* Takes the PC's turn for it, in headless games.  pc_next_pos() doesn't *
+ * look at the terrain, so a move into rock becomes a rest rather than   *
+ * a wasted attempt.                                                     */
+void pc_autopilot(dungeon *d)
+{
+  static const uint32_t keypad[3][3] = {
+    { 7, 8, 9 },
+    { 4, 5, 6 },
+    { 1, 2, 3 }
+  };
+  pair_t dir, next;
+
+  pc_next_pos(d, dir);
+
+  next[dim_y] = d->PC->position[dim_y] + dir[dim_y];
+  next[dim_x] = d->PC->position[dim_x] + dir[dim_x];
+
+  if ((dir[dim_y] || dir[dim_x]) && mappair(next) >= ter_floor) {
+    move_pc(d, keypad[dir[dim_y] + 1][dir[dim_x] + 1]);
+  }
+}
+
 uint32_t pc_in_room(dungeon *d, uint32_t room)
 {
   if ((room < d->num_rooms)                                     &&
@@ -225,32 +247,56 @@ void pc_learn_terrain(pc *p, pair_t pos, terrain_type ter)
 
 void pc_reset_visibility(pc *p)
 {
-  uint32_t y, x;
-
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      p->visible[y][x] = 0;
-    }
-  }
+  p->visible.fill(0);
 }
 
 terrain_type pc_learned_terrain(pc *p, int16_t y, int16_t x)
 {
-  if (y < 0 || y >= DUNGEON_Y || x < 0 || x >= DUNGEON_X) {
+  if (y < 0 || y >= (int32_t) p->known_terrain.height() ||
+      x < 0 || x >= (int32_t) p->known_terrain.width()) {
     io_queue_message("Invalid value to %s: %d, %d", __FUNCTION__, y, x);
   }
 
   return p->known_terrain[y][x];
 }
 
-void pc_init_known_terrain(pc *p)
+void pc_init_known_terrain(pc *p, dungeon *d)
 {
-  uint32_t y, x;
+  p->known_terrain.resize(d->width, d->height, ter_unknown);
+  p->visible.resize(d->width, d->height, 0);
+  p->sight.resize((d->width + 63) / 64, d->height, 0);
+  p->sight_origin[dim_x] = p->position[dim_x];
+  p->sight_origin[dim_y] = p->position[dim_y];
+}
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      p->known_terrain[y][x] = ter_unknown;
-      p->visible[y][x] = 0;
+void pc_update_sight(pc *p, dungeon *d)
+{
+  pair_t where;
+  int16_t y_min, y_max, x_min, x_max;
+  uint64_t *row;
+
+  /* Only the rows around the last origin have any bits to clear. */
+  y_min = std::max(p->sight_origin[dim_y] - PC_VISUAL_RANGE, 0);
+  y_max = std::min(p->sight_origin[dim_y] + PC_VISUAL_RANGE, d->height - 1);
+  for (where[dim_y] = y_min; where[dim_y] <= y_max; where[dim_y]++) {
+    std::fill(p->sight[where[dim_y]],
+              p->sight[where[dim_y]] + p->sight.width(), 0);
+  }
+
+  p->sight_origin[dim_x] = p->position[dim_x];
+  p->sight_origin[dim_y] = p->position[dim_y];
+
+  y_min = std::max(p->position[dim_y] - PC_VISUAL_RANGE, 0);
+  y_max = std::min(p->position[dim_y] + PC_VISUAL_RANGE, d->height - 1);
+  x_min = std::max(p->position[dim_x] - PC_VISUAL_RANGE, 0);
+  x_max = std::min(p->position[dim_x] + PC_VISUAL_RANGE, d->width - 1);
+
+  for (where[dim_y] = y_min; where[dim_y] <= y_max; where[dim_y]++) {
+    row = p->sight[where[dim_y]];
+    for (where[dim_x] = x_min; where[dim_x] <= x_max; where[dim_x]++) {
+      row[where[dim_x] / 64] |= ((uint64_t) can_see(d, p->position, where,
+                                                   1, 0) <<
+                                 (where[dim_x] % 64));
     }
   }
 }
@@ -265,16 +311,16 @@ void pc_observe_terrain(pc *p, dungeon *d)
     y_min = 0;
   }
   y_max = p->position[dim_y] + PC_VISUAL_RANGE;
-  if (y_max > DUNGEON_Y - 1) {
-    y_max = DUNGEON_Y - 1;
+  if (y_max > d->height - 1) {
+    y_max = d->height - 1;
   }
   x_min = p->position[dim_x] - PC_VISUAL_RANGE;
   if (x_min < 0) {
     x_min = 0;
   }
   x_max = p->position[dim_x] + PC_VISUAL_RANGE;
-  if (x_max > DUNGEON_X - 1) {
-    x_max = DUNGEON_X - 1;
+  if (x_max > d->width - 1) {
+    x_max = d->width - 1;
   }
 
   for (where[dim_y] = y_min; where[dim_y] <= y_max; where[dim_y]++) {
@@ -290,6 +336,8 @@ void pc_observe_terrain(pc *p, dungeon *d)
     where[dim_y] = y_max;
     can_see(d, p->position, where, 1, 1);
   }
+
+  pc_update_sight(p, d);
 }
 
 int32_t is_illuminated(pc *p, int16_t y, int16_t x)
@@ -38,27 +38,46 @@ class pc : public character {
   object *in[MAX_INVENTORY];
   pair_t target;
   uint32_t mana;
+  /* Autopilot state for pc_next_pos() */
+  uint32_t have_seen_corner;
+  uint32_t corner_count;
 
   uint32_t wear_in(uint32_t slot);
   uint32_t remove_eq(uint32_t slot);
   uint32_t drop_in(dungeon *d, uint32_t slot);
   uint32_t destroy_in(uint32_t slot);
   uint32_t pick_up(dungeon *d);
-  terrain_type known_terrain[DUNGEON_Y][DUNGEON_X];
-  uint8_t visible[DUNGEON_Y][DUNGEON_X];
+  /* Sized to the dungeon by pc_init_known_terrain(). */
+  grid<terrain_type> known_terrain;
+  grid<uint8_t> visible;
+  /* What the PC can see: bit x % 64 of sight[y][x / 64] is set when *
+   * can_see() from the PC to (x, y) is true.  pc_update_sight() sets *
+   * the bits around sight_origin; everywhere else is clear.           */
+  grid<uint64_t> sight;
+  pair_t sight_origin;
 };
 
 void pc_delete(pc *pc);
 uint32_t pc_is_alive(dungeon *d);
 void config_pc(dungeon *d);
 uint32_t pc_next_pos(dungeon *d, pair_t dir);
+void pc_autopilot(dungeon *d);
 void place_pc(dungeon *d);
 uint32_t pc_in_room(dungeon *d, uint32_t room);
 void pc_learn_terrain(pc *p, pair_t pos, terrain_type ter);
 terrain_type pc_learned_terrain(pc *p, int16_t y, int16_t x);
-void pc_init_known_terrain(pc *p);
+void pc_init_known_terrain(pc *p, dungeon *d);
 void pc_observe_terrain(pc *p, dungeon *d);
 int32_t is_illuminated(pc *p, int16_t y, int16_t x);
 void pc_reset_visibility(pc *p);
+/* Redoes sight, which has to be done whenever the PC moves or the  *
+ * terrain around it may have changed: the PC observing the terrain *
+ * does it, as does the start of each of the PC's turns.            */
+void pc_update_sight(pc *p, dungeon *d);
+
+static inline int32_t pc_can_see(pc *p, int16_t y, int16_t x)
+{
+  return (p->sight[y][x / 64] >> (x % 64)) & 1;
+}
 
 #endif
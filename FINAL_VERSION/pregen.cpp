@@ -0,0 +1,160 @@
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+
+#include "pregen.h"
+#include "dungeon.h"
+
+typedef struct pregen_level {
+  uint32_t number;
+  uint32_t num_rooms;
+  room_t *rooms;
+  grid<terrain_type> map;
+  grid<uint8_t> hardness;
+} pregen_level_t;
+
+struct pregen {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  /* Signalled whenever a level is added or taken, and on shutdown. */
+  pthread_cond_t changed;
+  /* Ready levels, a ring starting at head. */
+  pregen_level_t ready[PREGEN_DEPTH];
+  uint32_t head;
+  uint32_t count;
+  uint32_t stop;
+  /* The thread generates into this, set up like the game's dungeon. */
+  dungeon scratch;
+};
+
+/* Builds level n of d's game in d's map, hardness and rooms. */
+static void pregen_generate(dungeon *d, uint32_t n)
+{
+  d->rand.seed(d->seed, n);
+  gen_dungeon(d);
+}
+
+static void *pregen_worker(void *arg)
+{
+  struct pregen *p = (struct pregen *) arg;
+  pregen_level_t *l;
+  uint32_t n;
+
+  for (n = p->scratch.level + 1; ; n++) {
+    pthread_mutex_lock(&p->mutex);
+    while (p->count == PREGEN_DEPTH && !p->stop) {
+      pthread_cond_wait(&p->changed, &p->mutex);
+    }
+    if (p->stop) {
+      pthread_mutex_unlock(&p->mutex);
+      return NULL;
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    pregen_generate(&p->scratch, n);
+
+    /* Swapping hands the level over and takes back the buffers of the *
+     * one it replaces, so after the first few nothing is allocated.   */
+    pthread_mutex_lock(&p->mutex);
+    l = p->ready + (p->head + p->count) % PREGEN_DEPTH;
+    l->number = n;
+    l->num_rooms = p->scratch.num_rooms;
+    l->rooms = p->scratch.rooms;
+    p->scratch.rooms = NULL;
+    l->map.swap(p->scratch.map);
+    l->hardness.swap(p->scratch.hardness);
+    p->count++;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->mutex);
+  }
+}
+
+void pregen_start(dungeon *d)
+{
+  struct pregen *p;
+  uint32_t i;
+
+  p = new struct pregen;
+  p->head = p->count = p->stop = 0;
+  /* Every swap trades buffers of the same size. */
+  for (i = 0; i < PREGEN_DEPTH; i++) {
+    p->ready[i].rooms = NULL;
+    p->ready[i].map.resize(d->width, d->height, ter_wall);
+    p->ready[i].hardness.resize(d->width, d->height, 0);
+  }
+
+  p->scratch.width = d->width;
+  p->scratch.height = d->height;
+  p->scratch.corridor_engine = d->corridor_engine;
+  p->scratch.hardness_engine = d->hardness_engine;
+  p->scratch.room_engine = d->room_engine;
+  p->scratch.seed = d->seed;
+  p->scratch.level = d->level;
+  init_dungeon(&p->scratch);
+
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->changed, NULL);
+  if (pthread_create(&p->thread, NULL, pregen_worker, p)) {
+    perror("pthread_create");
+    exit(1);
+  }
+
+  d->pregen = p;
+}
+
+/* d's rooms must already have been freed. */
+void pregen_next(dungeon *d)
+{
+  struct pregen *p = d->pregen;
+  pregen_level_t *l;
+  rng game;
+
+  if (!p) {
+    game = d->rand;
+    pregen_generate(d, ++d->level);
+    d->rand = game;
+    return;
+  }
+
+  pthread_mutex_lock(&p->mutex);
+  while (!p->count) {
+    pthread_cond_wait(&p->changed, &p->mutex);
+  }
+  l = p->ready + p->head;
+  d->level = l->number;
+  d->num_rooms = l->num_rooms;
+  d->rooms = l->rooms;
+  l->rooms = NULL;
+  d->map.swap(l->map);
+  d->hardness.swap(l->hardness);
+  p->head = (p->head + 1) % PREGEN_DEPTH;
+  p->count--;
+  pthread_cond_broadcast(&p->changed);
+  pthread_mutex_unlock(&p->mutex);
+}
+
+void pregen_stop(dungeon *d)
+{
+  struct pregen *p = d->pregen;
+  uint32_t i;
+
+  if (!p) {
+    return;
+  }
+
+  pthread_mutex_lock(&p->mutex);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->changed);
+  pthread_mutex_unlock(&p->mutex);
+  pthread_join(p->thread, NULL);
+
+  for (i = 0; i < PREGEN_DEPTH; i++) {
+    free(p->ready[i].rooms);
+  }
+  delete_dungeon(&p->scratch);
+  pthread_cond_destroy(&p->changed);
+  pthread_mutex_destroy(&p->mutex);
+  delete p;
+
+  d->pregen = NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef PREGEN_H
+# define PREGEN_H
+
+# include <stdint.h>
+
+/* Level n of a game (the first is level 0) is generated from stream n  *
+ * of the game's seed rather than from the game's own generator, so it *
+ * doesn't depend on what happened on the levels before it and can be  *
+ * built before anyone takes the stairs.  The first level still comes  *
+ * from the game's generator, as it always has.                        *
+ *                                                                     *
+ * pregen_start() runs a thread that keeps the terrain and rooms of    *
+ * the next PREGEN_DEPTH levels ready.  pregen_next() installs the     *
+ * next level, taking it from the thread if there is one and building  *
+ * it on the spot if not; the level is the same either way.  Monsters, *
+ * objects and the PC are still placed by new_dungeon(), from the      *
+ * game's generator.                                                   */
+# define PREGEN_DEPTH 2
+
+class dungeon;
+
+void pregen_start(dungeon *d);
+void pregen_next(dungeon *d);
+void pregen_stop(dungeon *d);
+
+#endif
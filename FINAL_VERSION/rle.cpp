@@ -0,0 +1,199 @@
+#include <cstring>
+
+#include "rle.h"
+
+static uint8_t *rle_literal(uint8_t *dst, const uint8_t *src, size_t n)
+{
+  *dst++ = n - 1;
+  memcpy(dst, src, n);
+
+  return dst + n;
+}
+
+size_t rle_encode(const uint8_t *src, size_t n, uint8_t *dst)
+{
+  uint8_t *out;
+  size_t i, run, literal;
+
+  for (out = dst, literal = i = 0; i < n; ) {
+    for (run = 1; i + run < n && src[i + run] == src[i] && run < RLE_MAX_RUN;
+         run++)
+      ;
+
+    if (run >= RLE_MIN_RUN) {
+      if (literal) {
+        out = rle_literal(out, src + i - literal, literal);
+        literal = 0;
+      }
+      *out++ = 0x80 + run - RLE_MIN_RUN;
+      *out++ = src[i];
+      i += run;
+    } else {
+      i += run;
+      literal += run;
+      if (literal >= RLE_MAX_LITERAL) {
+        out = rle_literal(out, src + i - literal, RLE_MAX_LITERAL);
+        literal -= RLE_MAX_LITERAL;
+      }
+    }
+  }
+  if (literal) {
+    out = rle_literal(out, src + n - literal, literal);
+  }
+
+  return out - dst;
+}
+
+/* Most literals and runs are short.  While there's room for it on both *
+ * sides, one of up to RLE_SHORT bytes is copied or set RLE_SHORT bytes  *
+ * at a time, a fixed size the compiler does inline; the bytes past its *
+ * end are overwritten by whatever comes next.                          */
+#define RLE_SHORT 16
+
+int rle_decode(const uint8_t *src, size_t size, uint8_t *dst, size_t n)
+{
+  const uint8_t *end;
+  uint8_t *out, *out_end;
+  size_t len;
+
+  for (end = src + size, out = dst, out_end = dst + n; src < end; out += len) {
+    if (*src < 0x80) {
+      len = *src++ + 1;
+      if (len <= RLE_SHORT && (size_t) (end - src) >= RLE_SHORT &&
+          (size_t) (out_end - out) >= RLE_SHORT) {
+        memcpy(out, src, RLE_SHORT);
+      } else if (len > (size_t) (end - src) ||
+                 len > (size_t) (out_end - out)) {
+        return 1;
+      } else {
+        memcpy(out, src, len);
+      }
+      src += len;
+    } else {
+      len = *src++ - 0x80 + RLE_MIN_RUN;
+      if (src == end) {
+        return 1;
+      }
+      if (len <= RLE_SHORT && (size_t) (out_end - out) >= RLE_SHORT) {
+        memset(out, *src++, RLE_SHORT);
+      } else if (len > (size_t) (out_end - out)) {
+        return 1;
+      } else {
+        memset(out, *src++, len);
+      }
+    }
+  }
+
+  return out != out_end;
+}
+
+/* Cells per byte is 8 / bits; the first cell takes the low bits. */
+static void pack_cells(const uint8_t *cells, size_t n, uint32_t bits,
+                       uint8_t *dst)
+{
+  size_t i;
+
+  memset(dst, 0, (n * bits + 7) / 8);
+  if (bits == 4) {
+    for (i = 0; i < n; i++) {
+      dst[i / 2] |= (cells[i] & 0xf) << (4 * (i % 2));
+    }
+  } else {
+    for (i = 0; i < n; i++) {
+      dst[i / 8] |= (cells[i] != 0) << (i % 8);
+    }
+  }
+}
+
+/* A byte of packed cells at a time, rather than a shift and a mask per *
+ * cell.                                                               */
+static void unpack_cells(const uint8_t *src, size_t n, uint32_t bits,
+                         uint8_t *cells)
+{
+  size_t i;
+  uint32_t b, j;
+
+  if (bits == 4) {
+    for (i = 0; i + 2 <= n; i += 2) {
+      b = *src++;
+      cells[i] = b & 0xf;
+      cells[i + 1] = b >> 4;
+    }
+    if (i < n) {
+      cells[i] = *src & 0xf;
+    }
+  } else {
+    for (i = 0; i + 8 <= n; i += 8) {
+      for (b = *src++, j = 0; j < 8; j++) {
+        cells[i + j] = (b >> j) & 1;
+      }
+    }
+    for (b = *src, j = 0; i < n; i++, j++) {
+      cells[i] = (b >> j) & 1;
+    }
+  }
+}
+
+void rle_encode_plane(const uint8_t *cells, size_t n, uint32_t bits,
+                      std::vector<uint8_t> &out)
+{
+  std::vector<uint8_t> packed;
+  size_t size;
+
+  if (bits != 8) {
+    size = (n * bits + 7) / 8;
+    packed.resize(size);
+    pack_cells(cells, n, bits, packed.data());
+    cells = packed.data();
+    n = size;
+  }
+
+  out.resize(1 + rle_bound(n));
+  size = rle_encode(cells, n, out.data() + 1);
+  if (size < n) {
+    out[0] = RLE_PLANE_CODED;
+    out.resize(1 + size);
+  } else {
+    out[0] = RLE_PLANE_RAW;
+    memcpy(out.data() + 1, cells, n);
+    out.resize(1 + n);
+  }
+}
+
+/* Decodes the bytes of a plane, after its RLE_PLANE_* byte. */
+static int decode_bytes(const uint8_t *src, size_t size, uint8_t how,
+                        uint8_t *dst, size_t n)
+{
+  if (how == RLE_PLANE_CODED) {
+    return rle_decode(src, size, dst, n);
+  }
+  if (how != RLE_PLANE_RAW || size != n) {
+    return 1;
+  }
+  memcpy(dst, src, n);
+
+  return 0;
+}
+
+int rle_decode_plane(const uint8_t *src, size_t size, uint32_t bits,
+                     uint8_t *cells, size_t n)
+{
+  /* Kept between calls, so that a load doesn't allocate per plane. */
+  static thread_local std::vector<uint8_t> packed;
+
+  if (!size) {
+    return 1;
+  }
+
+  if (bits == 8) {
+    return decode_bytes(src + 1, size - 1, *src, cells, n);
+  }
+
+  packed.resize((n * bits + 7) / 8);
+  if (decode_bytes(src + 1, size - 1, *src, packed.data(), packed.size())) {
+    return 1;
+  }
+  unpack_cells(packed.data(), n, bits, cells);
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef RLE_H
+# define RLE_H
+
+# include <stdint.h>
+# include <stddef.h>
+# include <vector>
+
+/* Run-length coding for the cell planes of compressed save files, in *
+ * the style of PackBits.  Each control byte c is followed by either  *
+ * c + 1 bytes to copy, for c < 0x80, or one byte to repeat           *
+ * c - 0x80 + RLE_MIN_RUN times.  Hardness is mostly runs of 0 (the   *
+ * open floor) and 255 (the edge) with short runs of rock between,    *
+ * and decodes with nothing more than memcpy() and memset().          */
+# define RLE_MIN_RUN     3
+# define RLE_MAX_RUN     (0x7f + RLE_MIN_RUN)
+# define RLE_MAX_LITERAL 0x80
+
+/* The most rle_encode() can write for n bytes. */
+# define rle_bound(n) ((n) + ((n) + RLE_MAX_LITERAL - 1) / RLE_MAX_LITERAL)
+
+size_t rle_encode(const uint8_t *src, size_t n, uint8_t *dst);
+/* Decodes size bytes at src into exactly n bytes at dst.  Returns non- *
+ * zero if they don't decode to exactly that.                           */
+int rle_decode(const uint8_t *src, size_t size, uint8_t *dst, size_t n);
+
+/* A plane of n cells, each of which fits in bits (8, 4 or 1) bits, is *
+ * packed that tightly and then run-length coded: terrain takes 4 bits *
+ * a cell, and the PC's visibility 1.  A byte ahead of the coding says *
+ * whether it's RLE_PLANE_CODED or, when coding wouldn't make it any   *
+ * smaller, RLE_PLANE_RAW: the packed cells as they are.  Encoding     *
+ * replaces out.                                                       */
+# define RLE_PLANE_CODED 0
+# define RLE_PLANE_RAW   1
+
+void rle_encode_plane(const uint8_t *cells, size_t n, uint32_t bits,
+                      std::vector<uint8_t> &out);
+int rle_decode_plane(const uint8_t *src, size_t size, uint32_t bits,
+                     uint8_t *cells, size_t n);
+
+#endif
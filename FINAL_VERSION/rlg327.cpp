@@ -11,6 +11,11 @@
 #include "utils.h"
 #include "io.h"
 #include "object.h"
+#include "path.h"
+#include "bench.h"
+#include "sim.h"
+#include "pregen.h"
+#include "pack.h"
 
 const char *victory =
   "\n                                       o\n"
@@ -69,12 +74,48 @@ void usage(char *name)
   fprintf(stderr,
           "Usage: %s [-r|--rand <seed>] [-l|--load [<file>]]\n"
           "          [-s|--save [<file>]] [-i|--image <pgm file>]\n"
-          "          [-n|--nummon <count>] [-o|--objcount <oject count>]\n",
+          "          [-n|--nummon <count>] [-o|--objcount <oject count>]\n"
+          "          [-p|--path <heap|bucket>] [-e|--events <engine>]\n"
+          "          [-c|--corridors <dijkstra|astar>]\n"
+          "          [-P|--placement <restart|bitmap>] [-z|--encoding <raw|rle>]\n"
+          "          [-L|--los <bresenham|table>] [-a|--animate <hz>]\n"
+          "          [-d|--dims <width>x<height>]\n"
+          "          [-b|--bench <name> [args...]]\n"
+          "          [-h|--headless] [-S|--sim <games>] [-j|--jobs <threads>]\n"
+          "          [-m|--log <file>]\n",
           name);
 
   exit(-1);
 }
 
+/* Long switches are handled along with their short forms, which for *
+ * most is just their first letter.  These are the exceptions.        */
+static const struct {
+  const char *name;
+  char letter;
+} long_switches[] = {
+  { "-placement", 'P' },
+  { "-encoding",  'z' },
+  { "-los",       'L' },
+  { "-log",       'm' },
+  { 0,            0   }
+};
+
+static char switch_letter(const char *arg, uint32_t long_arg)
+{
+  uint32_t i;
+
+  if (long_arg) {
+    for (i = 0; long_switches[i].name; i++) {
+      if (!strcmp(arg, long_switches[i].name)) {
+        return long_switches[i].letter;
+      }
+    }
+  }
+
+  return arg[1];
+}
+
 int main(int argc, char *argv[])
 {
   dungeon d;
@@ -82,16 +123,23 @@ int main(int argc, char *argv[])
   struct timeval tv;
   int32_t i;
   uint32_t do_load, do_save, do_seed, do_image, do_save_seed, do_save_image;
+  uint32_t do_sim, sim_count, sim_jobs;
+  uint32_t animation_hz;
   uint32_t long_arg;
   char *save_file;
   char *load_file;
   char *pgm_file;
+  char *log_file;
 
   /* Default behavior: Seed with the time, generate a new dungeon, *
    * and don't write to disk.                                      */
   do_load = do_save = do_image = do_save_seed = do_save_image = 0;
+  do_sim = 0;
+  sim_count = 1;
+  sim_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  animation_hz = DEFAULT_ANIMATION_HZ;
   do_seed = 1;
-  save_file = load_file = NULL;
+  save_file = load_file = pgm_file = log_file = NULL;
   d.max_monsters = MAX_MONSTERS;
   d.max_objects = MAX_OBJECTS;
 
@@ -116,12 +164,12 @@ int main(int argc, char *argv[])
           argv[i]++;    /* Make the argument have a single dash so we can */
           long_arg = 1; /* handle long and short args at the same place.  */
         }
-        switch (argv[i][1]) {
+        switch (switch_letter(argv[i], long_arg)) {
         case 'n':
           if ((!long_arg && argv[i][2]) ||
               (long_arg && strcmp(argv[i], "-nummon")) ||
               argc < ++i + 1 /* No more arguments */ ||
-              !sscanf(argv[i], "%hu", &d.max_monsters)) {
+              !sscanf(argv[i], "%u", &d.max_monsters)) {
             usage(argv[0]);
           }
           break;
@@ -147,6 +195,15 @@ int main(int argc, char *argv[])
           }
           break;
         case 's':
+          if (long_arg && !strcmp(argv[i], "-sim")) {
+            /* Shares a letter with --save.  Short form is -S. */
+            if (argc < ++i + 1 /* No more arguments */ ||
+                !sscanf(argv[i], "%u", &sim_count)) {
+              usage(argv[0]);
+            }
+            do_sim = 1;
+            break;
+          }
           if ((!long_arg && argv[i][2]) ||
               (long_arg && strcmp(argv[i], "-save"))) {
             usage(argv[0]);
@@ -168,6 +225,41 @@ int main(int argc, char *argv[])
 	    }
           }
           break;
+        case 'S':
+          if (long_arg || argv[i][2] ||
+              argc < ++i + 1 /* No more arguments */ ||
+              !sscanf(argv[i], "%u", &sim_count)) {
+            usage(argv[0]);
+          }
+          do_sim = 1;
+          break;
+        case 'j':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-jobs")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              !sscanf(argv[i], "%u", &sim_jobs)) {
+            usage(argv[0]);
+          }
+          break;
+        case 'd':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-dims")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              sscanf(argv[i], "%hux%hu", &d.width, &d.height) != 2 ||
+              d.width < DUNGEON_X || d.width > MAX_DUNGEON_X ||
+              d.height < DUNGEON_Y || d.height > MAX_DUNGEON_Y) {
+            fprintf(stderr, "Dungeon dimensions must be from %dx%d to %dx%d.\n",
+                    DUNGEON_X, DUNGEON_Y, MAX_DUNGEON_X, MAX_DUNGEON_Y);
+            usage(argv[0]);
+          }
+          break;
+        case 'h':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-headless"))) {
+            usage(argv[0]);
+          }
+          do_sim = 1;
+          break;
         case 'i':
           if ((!long_arg && argv[i][2]) ||
               (long_arg && strcmp(argv[i], "-image"))) {
@@ -188,6 +280,154 @@ int main(int argc, char *argv[])
             usage(argv[0]);
           }
           break;
+        case 'p':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-path")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          for (d.path_engine = path_engine_heap;
+               (d.path_engine < num_path_engines &&
+                strcmp(argv[i], path_engine_name[d.path_engine]));
+               d.path_engine = (path_engine_t) (d.path_engine + 1))
+            ;
+          if (d.path_engine == num_path_engines) {
+            usage(argv[0]);
+          }
+          break;
+        case 'e':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-events")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          for (d.event_engine = event_engine_fibonacci;
+               (d.event_engine < num_event_engines &&
+                strcmp(argv[i], event_engine_name[d.event_engine]));
+               d.event_engine = (event_engine_t) (d.event_engine + 1))
+            ;
+          if (d.event_engine == num_event_engines) {
+            usage(argv[0]);
+          }
+          break;
+        case 'c':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-corridors")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          for (d.corridor_engine = corridor_engine_dijkstra;
+               (d.corridor_engine < num_corridor_engines &&
+                strcmp(argv[i], corridor_engine_name[d.corridor_engine]));
+               d.corridor_engine =
+                 (corridor_engine_t) (d.corridor_engine + 1))
+            ;
+          if (d.corridor_engine == num_corridor_engines) {
+            usage(argv[0]);
+          }
+          break;
+        case 'P':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-placement")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          for (d.room_engine = room_engine_restart;
+               (d.room_engine < num_room_engines &&
+                strcmp(argv[i], room_engine_name[d.room_engine]));
+               d.room_engine = (room_engine_t) (d.room_engine + 1))
+            ;
+          if (d.room_engine == num_room_engines) {
+            usage(argv[0]);
+          }
+          break;
+        case 'L':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-los")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          for (d.los_engine = los_engine_bresenham;
+               (d.los_engine < num_los_engines &&
+                strcmp(argv[i], los_engine_name[d.los_engine]));
+               d.los_engine = (los_engine_t) (d.los_engine + 1))
+            ;
+          if (d.los_engine == num_los_engines) {
+            usage(argv[0]);
+          }
+          break;
+        case 'm':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-log")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          log_file = argv[i];
+          break;
+        case 'a':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-animate")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              !sscanf(argv[i], "%u", &animation_hz) ||
+              animation_hz > MAX_ANIMATION_HZ) {
+            usage(argv[0]);
+          }
+          break;
+        case 'z':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-encoding")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          for (d.save_encoding = save_encoding_raw;
+               (d.save_encoding < num_save_encodings &&
+                strcmp(argv[i], save_encoding_name[d.save_encoding]));
+               d.save_encoding = (save_encoding_t) (d.save_encoding + 1))
+            ;
+          if (d.save_encoding == num_save_encodings) {
+            usage(argv[0]);
+          }
+          break;
+        case 'b':
+          /* Benchmarks don't play a game.  Everything after the name of *
+           * the benchmark belongs to the benchmark.                     */
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-bench")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          if (!strcmp(argv[i], "path")) {
+            return bench_path(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "events")) {
+            return bench_events(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "corridors")) {
+            return bench_corridors(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "hardness")) {
+            return bench_hardness(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "rooms")) {
+            return bench_rooms(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "load")) {
+            return bench_load(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "encoding")) {
+            return bench_encoding(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "descriptions")) {
+            return bench_descriptions(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "los")) {
+            return bench_los(argc - i - 1, argv + i + 1);
+          }
+          if (!strcmp(argv[i], "pgm")) {
+            return bench_pgm(argc - i - 1, argv + i + 1);
+          }
+          usage(argv[0]);
+          break;
         default:
           usage(argv[0]);
         }
@@ -204,9 +444,37 @@ int main(int argc, char *argv[])
     seed = (tv.tv_usec ^ (tv.tv_sec << 20)) & 0xffffffff;
   }
 
-  srand(seed);
+  if (do_sim) {
+    /* Headless games generate their own dungeons, one per seed, and *
+     * never touch the terminal.  A single game may load and save    *
+     * checkpoints; see sim.h.  Image doesn't apply.                 */
+    sim_checkpoint_t cp = { do_load, load_file, do_save, save_file };
+    std::string path;
+    int64_t level;
+
+    if (sim_count != 1 &&
+        ((do_load && !(load_file && pack_name(load_file, &path, &level) &&
+                       level < 0))                                       ||
+         (do_save && !(save_file && pack_name(save_file, &path, &level))))) {
+      fprintf(stderr, "Only a single headless game can load or save, "
+              "except with packs.\n");
+      usage(argv[0]);
+    }
+    if (log_file && io_open_log(log_file)) {
+      return -1;
+    }
+    parse_descriptions(&d);
+    i = sim_games(&d, sim_count, seed, sim_jobs, &cp);
+    destroy_descriptions(&d);
+
+    return i;
+  }
+
+  d.rand.seed(seed);
+  d.seed = seed;
 
   parse_descriptions(&d);
+  io_set_animation(animation_hz);
   io_init_terminal();
   init_dungeon(&d);
 
@@ -217,12 +485,16 @@ int main(int argc, char *argv[])
   } else {
     gen_dungeon(&d);
   }
+  pregen_start(&d);
 
-  /* Ignoring PC position in saved dungeons.  Not a bug. */
-  config_pc(&d);
-  gen_monsters(&d);
-  gen_objects(&d);
-  pc_observe_terrain(d.PC, &d);
+  /* Ignoring PC position in saved dungeons.  Not a bug.  Checkpoints *
+   * (version 2 saves) bring their own PC, monsters and objects.      */
+  if (!d.PC) {
+    config_pc(&d);
+    gen_monsters(&d);
+    gen_objects(&d);
+    pc_observe_terrain(d.PC, &d);
+  }
 
   io_display(&d);
   if (!do_load && !do_image) {
@@ -232,6 +504,7 @@ int main(int argc, char *argv[])
     do_moves(&d);
   }
   io_display(&d);
+  pregen_stop(&d);
 
   io_reset_terminal();
 
@@ -264,6 +537,7 @@ int main(int argc, char *argv[])
          "You avenged the cruel and untimely murders of %u "
          "peaceful dungeon residents.\n",
          d.PC->kills[kill_direct], d.PC->kills[kill_avenged]);
+  path_print_stats(&d, stdout);
 
   if (pc_is_alive(&d)) {
     /* If the PC is dead, it's in the move heap and will get automatically *
@@ -0,0 +1,73 @@
+#ifndef RNG_H
+# define RNG_H
+
+# include <stdint.h>
+
+/* Each dungeon owns one of these, and every random decision in a game *
+ * draws from it, so a seed and a sequence of player inputs replay a   *
+ * game exactly.  Nothing else may touch it; in particular, cosmetic   *
+ * randomness in the display uses its own generator, so that a game    *
+ * plays the same with or without a terminal.                          *
+ *                                                                     *
+ * The generator is PCG32 (O'Neill, pcg-random.org): 64 bits of state, *
+ * 32 bits out, one multiply and a rotate per number.  range() maps    *
+ * onto [min, max] with a multiply and shift instead of a division.    */
+class rng {
+ private:
+  uint64_t state;
+  uint64_t inc;
+ public:
+  rng()
+  {
+    seed(1);
+  }
+  inline void seed(uint64_t s)
+  {
+    seed(s, 0);
+  }
+  /* Picks one of 2^63 independent sequences for the seed.  Stream 0 is *
+   * what seed(s) gives.                                                */
+  inline void seed(uint64_t s, uint64_t stream)
+  {
+    state = 0;
+    inc = (stream << 1) | 1;
+    next();
+    state += s;
+    next();
+  }
+  inline uint32_t next()
+  {
+    uint64_t old;
+    uint32_t xorshifted, rot;
+
+    old = state;
+    state = old * 6364136223846793005ULL + inc;
+    xorshifted = ((old >> 18) ^ old) >> 27;
+    rot = old >> 59;
+
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+  }
+  /* For checkpoints, which have to resume the sequence exactly. */
+  inline void get_state(uint64_t &s, uint64_t &i) const
+  {
+    s = state;
+    i = inc;
+  }
+  inline void set_state(uint64_t s, uint64_t i)
+  {
+    state = s;
+    inc = i;
+  }
+  /* Uniform in [min, max].  range(min, min - 1) yields min. */
+  inline uint32_t range(uint32_t min, uint32_t max)
+  {
+    return min + ((((uint64_t) next()) * (max - min + 1)) >> 32);
+  }
+  /* True with probability numerator/denominator. */
+  inline bool under(uint32_t numerator, uint32_t denominator)
+  {
+    return next() < (UINT32_MAX / denominator) * numerator;
+  }
+};
+
+#endif
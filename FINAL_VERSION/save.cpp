@@ -0,0 +1,488 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+#include "save.h"
+#include "dungeon.h"
+#include "pc.h"
+#include "npc.h"
+#include "object.h"
+#include "event.h"
+#include "path.h"
+#include "rle.h"
+
+static void save_character(character *c, uint32_t description, uint32_t on_map,
+                           character_record_t &r)
+{
+  uint32_t i;
+
+  memset(&r, 0, sizeof (r));
+  r.description = htole32(description);
+  r.position[dim_x] = htole16(c->position[dim_x]);
+  r.position[dim_y] = htole16(c->position[dim_y]);
+  r.speed = htole32(c->speed);
+  r.hp = htole32(c->hp);
+  r.poison_damage = htole32(c->poisonDamage);
+  r.sequence_number = htole32(c->sequence_number);
+  for (i = 0; i < num_kill_types; i++) {
+    r.kills[i] = htole32(c->kills[i]);
+  }
+  r.alive = c->alive;
+  r.on_map = on_map;
+}
+
+static void save_object(dungeon *d, object *o, object_location_t location,
+                        int16_t x, int16_t y, std::vector<object_record_t> &v)
+{
+  object_record_t r;
+
+  memset(&r, 0, sizeof (r));
+  o->save(d, r);
+  r.location = location;
+  r.where[dim_x] = htole16(x);
+  r.where[dim_y] = htole16(y);
+  v.push_back(r);
+}
+
+/* Replaces a plane with its length, little-endian, and its coding. */
+static void compress_plane(std::vector<uint8_t> &plane, uint32_t bits)
+{
+  std::vector<uint8_t> coded;
+  uint32_t le32;
+
+  rle_encode_plane(plane.data(), plane.size(), bits, coded);
+  le32 = htole32(coded.size());
+  plane.resize(sizeof (le32) + coded.size());
+  memcpy(plane.data(), &le32, sizeof (le32));
+  memcpy(plane.data() + sizeof (le32), coded.data(), coded.size());
+}
+
+void capture_game_state(dungeon *d, game_state_t *s)
+{
+  game_record_t &g = s->game;
+  std::unordered_map<character *, uint32_t> index;
+  std::vector<event *> events;
+  uint64_t state, inc;
+  uint32_t i, cells, x, y;
+  character_record_t *r;
+  object *o;
+  npc *n;
+
+  cells = d->width * d->height;
+
+  memset(&g, 0, sizeof (g));
+  d->rand.get_state(state, inc);
+  g.seed = htole64(d->seed);
+  g.rand_state = htole64(state);
+  g.rand_inc = htole64(inc);
+  g.level = htole32(d->level);
+  g.time = htole32(d->time);
+  g.is_new = htole32(d->is_new);
+  g.character_sequence_number = htole32(d->character_sequence_number);
+  g.event_sequence_number = htole32(d->event_sequence_number);
+  g.num_monsters = htole32(d->num_monsters);
+  g.max_monsters = htole32(d->max_monsters);
+  g.num_objects = htole16(d->num_objects);
+  g.max_objects = htole16(d->max_objects);
+  g.corridor_engine = d->corridor_engine;
+  g.room_engine = d->room_engine;
+  g.num_rooms = htole16(d->num_rooms);
+  g.pc_mana = htole32(d->PC->mana);
+  g.pc_target[dim_x] = htole16(d->PC->target[dim_x]);
+  g.pc_target[dim_y] = htole16(d->PC->target[dim_y]);
+  g.pc_have_seen_corner = htole32(d->PC->have_seen_corner);
+  g.pc_corner_count = htole32(d->PC->corner_count);
+
+  /* terrain_type is packed, so the map is already a byte per cell. */
+  s->hardness.assign(d->hardness.data(), d->hardness.data() + cells);
+  s->map.assign((uint8_t *) d->map.data(), (uint8_t *) d->map.data() + cells);
+  s->known_terrain.assign((uint8_t *) d->PC->known_terrain.data(),
+                          (uint8_t *) d->PC->known_terrain.data() + cells);
+  s->visible.assign(d->PC->visible.data(), d->PC->visible.data() + cells);
+  s->compressed = save_compressed(d);
+  if (s->compressed) {
+    compress_plane(s->hardness, 8);
+    compress_plane(s->map, 4);
+    compress_plane(s->known_terrain, 4);
+    compress_plane(s->visible, 1);
+  }
+
+  s->rooms.resize(d->num_rooms);
+  for (i = 0; i < d->num_rooms; i++) {
+    s->rooms[i].position[dim_x] = htole16(d->rooms[i].position[dim_x]);
+    s->rooms[i].position[dim_y] = htole16(d->rooms[i].position[dim_y]);
+    s->rooms[i].size[dim_x] = htole16(d->rooms[i].size[dim_x]);
+    s->rooms[i].size[dim_y] = htole16(d->rooms[i].size[dim_y]);
+  }
+
+  /* Monsters only live in the event queue, one event each. */
+  events.resize(eventq_size(&d->events));
+  eventq_list(&d->events, events.data());
+
+  s->characters.resize(1);
+  save_character(d->PC, 0, charpair(d->PC->position) == d->PC,
+                 s->characters[0]);
+  index[d->PC] = 0;
+  s->events.resize(events.size());
+  for (i = 0; i < events.size(); i++) {
+    if (!index.count(events[i]->c)) {
+      n = (npc *) events[i]->c;
+      index[n] = s->characters.size();
+      s->characters.resize(s->characters.size() + 1);
+      save_character(n, &n->md - d->monster_descriptions.data(),
+                     charpair(n->position) == n, s->characters.back());
+      r = &s->characters.back();
+      r->pc_last_known_position[dim_x] =
+        htole16(n->pc_last_known_position[dim_x]);
+      r->pc_last_known_position[dim_y] =
+        htole16(n->pc_last_known_position[dim_y]);
+      r->characteristics = htole32(n->characteristics);
+      r->have_seen_pc = n->have_seen_pc;
+    }
+    s->events[i].type = htole32(events[i]->type);
+    s->events[i].time = htole32(events[i]->time);
+    s->events[i].sequence = htole32(events[i]->sequence);
+    s->events[i].character = htole32(index[events[i]->c]);
+  }
+
+  s->objects.clear();
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
+      for (o = d->objmap[y][x]; o; o = o->get_next()) {
+        save_object(d, o, object_on_floor, x, y, s->objects);
+      }
+    }
+  }
+  for (i = 0; i < num_eq_slots; i++) {
+    if (d->PC->eq[i]) {
+      save_object(d, d->PC->eq[i], object_equipped, i, 0, s->objects);
+    }
+  }
+  for (i = 0; i < MAX_INVENTORY; i++) {
+    if (d->PC->in[i]) {
+      save_object(d, d->PC->in[i], object_carried, i, 0, s->objects);
+    }
+  }
+
+  s->monster_counters.resize(d->monster_descriptions.size());
+  for (i = 0; i < d->monster_descriptions.size(); i++) {
+    s->monster_counters[i].count[0] =
+      htole32(d->monster_descriptions[i].get_num_alive());
+    s->monster_counters[i].count[1] =
+      htole32(d->monster_descriptions[i].get_num_killed());
+  }
+  s->object_counters.resize(d->object_descriptions.size());
+  for (i = 0; i < d->object_descriptions.size(); i++) {
+    s->object_counters[i].count[0] =
+      htole32(d->object_descriptions[i].get_num_generated());
+    s->object_counters[i].count[1] =
+      htole32(d->object_descriptions[i].get_num_found());
+  }
+
+  g.num_characters = htole32(s->characters.size());
+  g.num_object_records = htole32(s->objects.size());
+  g.num_events = htole32(s->events.size());
+  g.num_monster_descriptions = htole32(s->monster_counters.size());
+  g.num_object_descriptions = htole32(s->object_counters.size());
+}
+
+/* What the records after the cell planes add up to, given the counts *
+ * in the game record.  In 64 bits, so that absurd counts in a bad    *
+ * file can't wrap around.                                            */
+static uint64_t records_size(const game_record_t &g)
+{
+  return ((uint64_t) le16toh(g.num_rooms) * sizeof (room_record_t)          +
+          (uint64_t) le32toh(g.num_characters) * sizeof (character_record_t) +
+          (uint64_t) le32toh(g.num_object_records) * sizeof (object_record_t) +
+          (uint64_t) le32toh(g.num_events) * sizeof (event_record_t)         +
+          (((uint64_t) le32toh(g.num_monster_descriptions) +
+            le32toh(g.num_object_descriptions)) *
+           sizeof (counter_record_t)));
+}
+
+uint32_t game_state_size(const game_state_t *s)
+{
+  return (sizeof (s->game) + s->hardness.size() + s->map.size() +
+          s->known_terrain.size() + s->visible.size() +
+          records_size(s->game));
+}
+
+template <class T>
+static uint8_t *write_section(const std::vector<T> &v, uint8_t *dst)
+{
+  if (v.size()) {
+    memcpy(dst, v.data(), v.size() * sizeof (T));
+  }
+
+  return dst + v.size() * sizeof (T);
+}
+
+uint8_t *write_game_state(const game_state_t *s, uint8_t *dst)
+{
+  memcpy(dst, &s->game, sizeof (s->game));
+  dst += sizeof (s->game);
+  dst = write_section(s->hardness, dst);
+  dst = write_section(s->map, dst);
+  dst = write_section(s->known_terrain, dst);
+  dst = write_section(s->visible, dst);
+  dst = write_section(s->rooms, dst);
+  dst = write_section(s->characters, dst);
+  dst = write_section(s->objects, dst);
+  dst = write_section(s->events, dst);
+  dst = write_section(s->monster_counters, dst);
+  dst = write_section(s->object_counters, dst);
+
+  return dst;
+}
+
+static void read_section(void *dst, size_t size,
+                         const uint8_t *&src, const uint8_t *end)
+{
+  if ((size_t) (end - src) < size) {
+    fprintf(stderr, "Truncated save file.\n");
+    exit(-1);
+  }
+  if (size) {
+    memcpy(dst, src, size);
+  }
+  src += size;
+}
+
+template <class T>
+static void read_section(std::vector<T> &v, uint32_t count,
+                         const uint8_t *&src, const uint8_t *end)
+{
+  v.resize(count);
+  read_section(v.data(), count * sizeof (T), src, end);
+}
+
+/* A plane of cells, each in bits bits, either raw or as written by *
+ * compress_plane().                                                 */
+static void read_plane(uint8_t *dst, uint32_t cells, uint32_t bits,
+                       uint32_t compressed,
+                       const uint8_t *&src, const uint8_t *end)
+{
+  uint32_t size;
+
+  if (!compressed) {
+    read_section(dst, cells, src, end);
+    return;
+  }
+
+  read_section(&size, sizeof (size), src, end);
+  size = le32toh(size);
+  if ((size_t) (end - src) < size) {
+    fprintf(stderr, "Truncated save file.\n");
+    exit(-1);
+  }
+  if (rle_decode_plane(src, size, bits, dst, cells)) {
+    fprintf(stderr, "Invalid cell plane in restored game.\n");
+    exit(-1);
+  }
+  src += size;
+}
+
+/* x and y as stored, little-endian. */
+static void check_position(dungeon *d, int16_t x, int16_t y, const char *what)
+{
+  x = le16toh(x);
+  y = le16toh(y);
+  if (x < 0 || x >= d->width || y < 0 || y >= d->height) {
+    fprintf(stderr, "Invalid %s position in restored game.\n", what);
+    exit(-1);
+  }
+}
+
+const uint8_t *read_game_state(dungeon *d, const uint8_t *src, uint32_t size,
+                               uint32_t compressed)
+{
+  const uint8_t *end = src + size;
+  game_state_t s;
+  game_record_t &g = s.game;
+  std::vector<character *> characters;
+  uint32_t i, cells, slot, y;
+  object *o;
+  event *e;
+  pair_t p;
+
+  cells = d->width * d->height;
+
+  read_section(&g, sizeof (g), src, end);
+  if (!compressed && size != sizeof (g) + 4ULL * cells + records_size(g)) {
+    fprintf(stderr, "Save file size doesn't match its contents.\n");
+    exit(-1);
+  }
+  if (le32toh(g.num_monster_descriptions) != d->monster_descriptions.size() ||
+      le32toh(g.num_object_descriptions) != d->object_descriptions.size()) {
+    fprintf(stderr, "Saved game was played with other %s and %s.\n",
+            MONSTER_DESC_FILE, OBJECT_DESC_FILE);
+    exit(-1);
+  }
+  if (!le32toh(g.num_characters)                   ||
+      g.corridor_engine >= num_corridor_engines    ||
+      g.room_engine >= num_room_engines) {
+    fprintf(stderr, "Invalid game record in restored game.\n");
+    exit(-1);
+  }
+
+  /* The terrain goes straight into place. */
+  read_plane(d->hardness.data(), cells, 8, compressed, src, end);
+  read_plane((uint8_t *) d->map.data(), cells, 4, compressed, src, end);
+  for (i = 0; i < cells; i++) {
+    if (d->map.data()[i] > ter_stairs_down) {
+      fprintf(stderr, "Invalid terrain in restored game.\n");
+      exit(-1);
+    }
+  }
+
+  if (d->PC) {
+    character_delete(d->PC);
+  }
+  d->PC = new pc;
+  pc_init_known_terrain(d->PC, d);
+  read_plane((uint8_t *) d->PC->known_terrain.data(), cells, 4, compressed,
+             src, end);
+  read_plane(d->PC->visible.data(), cells, 1, compressed, src, end);
+  /* Only now is there a size to check a compressed file against. */
+  if ((uint64_t) (end - src) != records_size(g)) {
+    fprintf(stderr, "Save file size doesn't match its contents.\n");
+    exit(-1);
+  }
+
+  read_section(s.rooms, le16toh(g.num_rooms), src, end);
+  d->num_rooms = s.rooms.size();
+  d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
+  for (i = 0; i < d->num_rooms; i++) {
+    d->rooms[i].position[dim_x] = le16toh(s.rooms[i].position[dim_x]);
+    d->rooms[i].position[dim_y] = le16toh(s.rooms[i].position[dim_y]);
+    d->rooms[i].size[dim_x] = le16toh(s.rooms[i].size[dim_x]);
+    d->rooms[i].size[dim_y] = le16toh(s.rooms[i].size[dim_y]);
+    if (d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] > d->width ||
+        d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y] > d->height) {
+      fprintf(stderr, "Invalid room in restored game.\n");
+      exit(-1);
+    }
+  }
+
+  /* Constructing characters and objects disturbs the description *
+   * counters, so those are put back at the end.                  */
+  read_section(s.characters, le32toh(g.num_characters), src, end);
+  characters.resize(s.characters.size());
+  characters[0] = d->PC;
+  for (i = 0; i < s.characters.size(); i++) {
+    character_record_t &r = s.characters[i];
+
+    check_position(d, r.position[dim_x], r.position[dim_y], "character");
+    if (i) {
+      if (le32toh(r.description) >= d->monster_descriptions.size()) {
+        fprintf(stderr, "Invalid monster in restored game.\n");
+        exit(-1);
+      }
+      characters[i] = new npc(d->monster_descriptions[le32toh(r.description)],
+                              r);
+    } else {
+      d->PC->position[dim_x] = le16toh(r.position[dim_x]);
+      d->PC->position[dim_y] = le16toh(r.position[dim_y]);
+      d->PC->speed = le32toh(r.speed);
+      d->PC->hp = le32toh(r.hp);
+      d->PC->poisonDamage = le32toh(r.poison_damage);
+      d->PC->alive = r.alive;
+      d->PC->sequence_number = le32toh(r.sequence_number);
+      d->PC->kills[kill_direct] = le32toh(r.kills[kill_direct]);
+      d->PC->kills[kill_avenged] = le32toh(r.kills[kill_avenged]);
+    }
+    if (r.on_map) {
+      charpair(characters[i]->position) = characters[i];
+    }
+  }
+  d->PC->mana = le32toh(g.pc_mana);
+  d->PC->target[dim_x] = le16toh(g.pc_target[dim_x]);
+  d->PC->target[dim_y] = le16toh(g.pc_target[dim_y]);
+  d->PC->have_seen_corner = le32toh(g.pc_have_seen_corner);
+  d->PC->corner_count = le32toh(g.pc_corner_count);
+
+  /* Piles were written top first, so build them from the bottom up. */
+  read_section(s.objects, le32toh(g.num_object_records), src, end);
+  for (i = s.objects.size(); i--; ) {
+    object_record_t &r = s.objects[i];
+
+    if (le32toh(r.description) >= d->object_descriptions.size()) {
+      fprintf(stderr, "Invalid object in restored game.\n");
+      exit(-1);
+    }
+    slot = (uint16_t) le16toh(r.where[dim_x]);
+    y = (uint16_t) le16toh(r.where[dim_y]);
+    if ((r.location == object_on_floor &&
+         (slot >= d->width || y >= d->height))                         ||
+        (r.location == object_equipped &&
+         (slot >= num_eq_slots || d->PC->eq[slot]))                    ||
+        (r.location == object_carried &&
+         (slot >= MAX_INVENTORY || d->PC->in[slot]))                   ||
+        r.location > object_carried) {
+      fprintf(stderr, "Invalid object location in restored game.\n");
+      exit(-1);
+    }
+    o = new object(d->object_descriptions[le32toh(r.description)], r);
+    switch (r.location) {
+    case object_on_floor:
+      p[dim_x] = slot;
+      p[dim_y] = y;
+      o->to_pile(d, p);
+      break;
+    case object_equipped:
+      d->PC->eq[slot] = o;
+      break;
+    case object_carried:
+      d->PC->in[slot] = o;
+      break;
+    }
+  }
+
+  read_section(s.events, le32toh(g.num_events), src, end);
+  for (i = 0; i < s.events.size(); i++) {
+    if (le32toh(s.events[i].type) != event_character_turn ||
+        le32toh(s.events[i].character) >= characters.size()) {
+      fprintf(stderr, "Invalid event in restored game.\n");
+      exit(-1);
+    }
+    e = eventq_alloc(&d->events);
+    e->type = (eventype_t) le32toh(s.events[i].type);
+    e->time = le32toh(s.events[i].time);
+    e->sequence = le32toh(s.events[i].sequence);
+    e->c = characters[le32toh(s.events[i].character)];
+    eventq_insert(&d->events, e);
+  }
+
+  read_section(s.monster_counters, le32toh(g.num_monster_descriptions),
+               src, end);
+  for (i = 0; i < s.monster_counters.size(); i++) {
+    d->monster_descriptions[i].restore(le32toh(s.monster_counters[i].count[0]),
+                                       le32toh(s.monster_counters[i].count[1]));
+  }
+  read_section(s.object_counters, le32toh(g.num_object_descriptions),
+               src, end);
+  for (i = 0; i < s.object_counters.size(); i++) {
+    d->object_descriptions[i].restore(le32toh(s.object_counters[i].count[0]),
+                                      le32toh(s.object_counters[i].count[1]));
+  }
+
+  d->seed = le64toh(g.seed);
+  d->rand.set_state(le64toh(g.rand_state), le64toh(g.rand_inc));
+  d->level = le32toh(g.level);
+  d->time = le32toh(g.time);
+  d->is_new = le32toh(g.is_new);
+  d->character_sequence_number = le32toh(g.character_sequence_number);
+  d->event_sequence_number = le32toh(g.event_sequence_number);
+  d->num_monsters = le32toh(g.num_monsters);
+  d->max_monsters = le32toh(g.max_monsters);
+  d->num_objects = le16toh(g.num_objects);
+  d->max_objects = le16toh(g.max_objects);
+  d->corridor_engine = (corridor_engine_t) g.corridor_engine;
+  d->room_engine = (room_engine_t) g.room_engine;
+
+  pc_update_sight(d->PC, d);
+  dijkstra_invalidate(d);
+
+  return src;
+}
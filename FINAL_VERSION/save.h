@@ -0,0 +1,132 @@
+#ifndef SAVE_H
+# define SAVE_H
+
+# include <stdint.h>
+# include <endian.h>
+# include <vector>
+
+# include "dims.h"
+# include "character.h"
+
+/* Version 2 save files (DUNGEON_SAVE_VERSION_GAME) are checkpoints of a *
+ * game in progress, so that it carries on exactly as it would have.    *
+ * After the version 1 header comes one game_record_t, then a byte per  *
+ * cell, in row order, of the hardness, the terrain, and what the PC    *
+ * knows and can see, then arrays of the fixed-size records below:      *
+ * rooms, characters (the PC first), objects, events in the order the   *
+ * queue would give them up, and the monster and object description    *
+ * counters.  Each section is a single memcpy() to or from the file's  *
+ * image in memory.  The header is big-endian, as in the other          *
+ * versions; the records are packed and little-endian.                  */
+
+typedef struct __attribute__ ((__packed__)) game_record {
+  uint64_t seed;
+  uint64_t rand_state;
+  uint64_t rand_inc;
+  uint32_t level;
+  uint32_t time;
+  uint32_t is_new;
+  uint32_t character_sequence_number;
+  uint32_t event_sequence_number;
+  uint32_t num_monsters;
+  uint32_t max_monsters;
+  uint16_t num_objects;
+  uint16_t max_objects;
+  uint8_t corridor_engine;
+  uint8_t room_engine;
+  uint16_t num_rooms;
+  uint32_t num_characters;
+  uint32_t num_object_records;
+  uint32_t num_events;
+  uint32_t num_monster_descriptions;
+  uint32_t num_object_descriptions;
+  /* What only the PC has; the rest is in its character record. */
+  uint32_t pc_mana;
+  int16_t pc_target[num_dims];
+  uint32_t pc_have_seen_corner;
+  uint32_t pc_corner_count;
+} game_record_t;
+
+typedef struct __attribute__ ((__packed__)) room_record {
+  uint16_t position[num_dims];
+  uint16_t size[num_dims];
+} room_record_t;
+
+typedef struct __attribute__ ((__packed__)) character_record {
+  /* Index into monster_descriptions; unused for the PC. */
+  uint32_t description;
+  int16_t position[num_dims];
+  int16_t pc_last_known_position[num_dims];
+  int32_t speed;
+  uint32_t hp;
+  int32_t poison_damage;
+  uint32_t sequence_number;
+  uint32_t kills[num_kill_types];
+  uint32_t characteristics;
+  uint8_t alive;
+  /* Dead monsters wait in the event queue, off the map. */
+  uint8_t on_map;
+  uint8_t have_seen_pc;
+  uint8_t unused;
+} character_record_t;
+
+typedef enum object_location {
+  object_on_floor,
+  object_equipped,
+  object_carried
+} object_location_t;
+
+typedef struct __attribute__ ((__packed__)) object_record {
+  /* Index into object_descriptions. */
+  uint32_t description;
+  uint8_t location;
+  uint8_t seen;
+  /* The cell of the pile, top first, for objects on the floor; the *
+   * slot in [dim_x] for the others.                                 */
+  int16_t where[num_dims];
+  int16_t position[num_dims];
+  int32_t hit, dodge, defence, weight, speed, attribute, value;
+} object_record_t;
+
+typedef struct __attribute__ ((__packed__)) event_record {
+  uint32_t type;
+  uint32_t time;
+  uint32_t sequence;
+  /* Index into the character records. */
+  uint32_t character;
+} event_record_t;
+
+/* num_alive and num_killed for monsters; num_generated and num_found *
+ * for objects.                                                        */
+typedef struct __attribute__ ((__packed__)) counter_record {
+  uint32_t count[2];
+} counter_record_t;
+
+class dungeon;
+
+typedef struct game_state {
+  game_record_t game;
+  /* Under DUNGEON_SAVE_COMPRESSED, each of the cell planes is instead *
+   * its coded length, 4 bytes, and its coding; see rle.h.  Terrain   *
+   * takes 4 bits a cell, and visibility 1.                           */
+  uint32_t compressed;
+  std::vector<uint8_t> hardness, map, known_terrain, visible;
+  std::vector<room_record_t> rooms;
+  std::vector<character_record_t> characters;
+  std::vector<object_record_t> objects;
+  std::vector<event_record_t> events;
+  std::vector<counter_record_t> monster_counters, object_counters;
+} game_state_t;
+
+/* Everything in the file after the header. */
+void capture_game_state(dungeon *d, game_state_t *s);
+uint32_t game_state_size(const game_state_t *s);
+/* Fills game_state_size() bytes at dst and returns the end of them. */
+uint8_t *write_game_state(const game_state_t *s, uint8_t *dst);
+/* Reads the game at src, of at most size bytes, into d, which       *
+ * read_dungeon() has already sized, and returns the end of what it  *
+ * read.  Exits on a malformed file, as the other readers do.         */
+const uint8_t *read_game_state(dungeon *d, const uint8_t *src, uint32_t size,
+                               uint32_t compressed);
+
+#endif
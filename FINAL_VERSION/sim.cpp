@@ -0,0 +1,311 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <pthread.h>
+
+#include "sim.h"
+#include "dungeon.h"
+#include "pc.h"
+#include "npc.h"
+#include "move.h"
+#include "object.h"
+#include "io.h"
+#include "utils.h"
+#include "pack.h"
+
+typedef enum sim_outcome {
+  sim_won,
+  sim_died,
+  sim_draw,
+  num_sim_outcomes
+} sim_outcome_t;
+
+static const char *sim_outcome_name[num_sim_outcomes] = {
+  "won",
+  "died",
+  "draw"
+};
+
+typedef struct sim_game {
+  uint64_t seed;
+  uint32_t turns;
+  uint32_t time;
+  uint32_t kills;
+  sim_outcome_t outcome;
+  double elapsed;
+} sim_game_t;
+
+typedef struct sim {
+  dungeon *proto;
+  uint32_t games;
+  uint32_t seed;
+  /* Games are handed out one at a time, because their lengths vary by *
+   * orders of magnitude.  Claimed with an atomic increment.           */
+  uint32_t next_game;
+  sim_game_t *game;
+  const sim_checkpoint_t *cp;
+  /* Game n plays level n of levels, when loading from a pack. */
+  pack_t *levels;
+  /* When saving to a pack, each game's first level goes into corpus, *
+   * in order of seed, however the threads happen to finish.  Levels  *
+   * wait in pending until those before them are in.                  */
+  pack_writer_t *corpus;
+  std::vector<std::vector<uint8_t> > pending;
+  uint32_t next_append;
+  uint32_t append_failed;
+  pthread_mutex_t lock;
+} sim_t;
+
+typedef struct sim_worker {
+  sim_t *s;
+  pthread_t thread;
+  /* Deaths, indexed like proto->monster_descriptions. */
+  std::vector<uint32_t> killed;
+} sim_worker_t;
+
+static void sim_append(sim_t *s, uint32_t n, dungeon *d)
+{
+  std::vector<uint8_t> image;
+
+  dungeon_image(d, image);
+
+  pthread_mutex_lock(&s->lock);
+  s->pending[n].swap(image);
+  while (s->next_append < s->games && s->pending[s->next_append].size()) {
+    if (pack_append(s->corpus, s->pending[s->next_append].data(),
+                    s->pending[s->next_append].size())) {
+      s->append_failed = 1;
+    }
+    std::vector<uint8_t>().swap(s->pending[s->next_append++]);
+  }
+  pthread_mutex_unlock(&s->lock);
+}
+
+static void sim_play(sim_worker_t *w, uint32_t n)
+{
+  dungeon d;
+  sim_game_t *g;
+  const uint8_t *level;
+  uint32_t i, size;
+  double start;
+
+  g = w->s->game + n;
+
+  d.max_monsters = w->s->proto->max_monsters;
+  d.max_objects = w->s->proto->max_objects;
+  d.width = w->s->proto->width;
+  d.height = w->s->proto->height;
+  d.path_engine = w->s->proto->path_engine;
+  d.event_engine = w->s->proto->event_engine;
+  d.corridor_engine = w->s->proto->corridor_engine;
+  d.hardness_engine = w->s->proto->hardness_engine;
+  d.room_engine = w->s->proto->room_engine;
+  d.los_engine = w->s->proto->los_engine;
+  d.save_encoding = w->s->proto->save_encoding;
+  d.monster_descriptions = w->s->proto->monster_descriptions;
+  d.object_descriptions = w->s->proto->object_descriptions;
+
+  d.rand.seed(w->s->seed + n);
+  d.seed = w->s->seed + n;
+  io_log_game(d.seed);
+
+  init_dungeon(&d);
+  if (w->s->levels) {
+    level = pack_level(w->s->levels, n, &size);
+    read_dungeon_image(&d, level, size);
+  } else if (w->s->cp->load) {
+    read_dungeon(&d, w->s->cp->load_file);
+  } else {
+    gen_dungeon(&d);
+  }
+  if (!d.PC) {
+    config_pc(&d);
+    gen_monsters(&d);
+    gen_objects(&d);
+    pc_observe_terrain(d.PC, &d);
+  }
+  if (w->s->corpus) {
+    sim_append(w->s, n, &d);
+  }
+
+  g->seed = d.seed;
+
+  /* Only the game itself is timed, not level generation. */
+  start = wall_time();
+
+  for (g->turns = 0;
+       pc_is_alive(&d) && boss_is_alive(&d) && g->turns < SIM_MAX_TURNS;
+       g->turns++) {
+    do_moves(&d);
+  }
+
+  g->elapsed = wall_time() - start;
+
+  if (!pc_is_alive(&d)) {
+    g->outcome = sim_died;
+  } else if (!boss_is_alive(&d)) {
+    g->outcome = sim_won;
+  } else {
+    g->outcome = sim_draw;
+  }
+  g->time = d.time;
+  g->kills = d.PC->kills[kill_direct] + d.PC->kills[kill_avenged];
+
+  if (w->s->cp->save) {
+    write_game(&d, w->s->cp->save_file);
+  }
+
+  for (i = 0; i < d.monster_descriptions.size(); i++) {
+    w->killed[i] += d.monster_descriptions[i].get_num_killed();
+  }
+
+  /* Same dance as at the end of main(). */
+  if (pc_is_alive(&d)) {
+    character_delete(d.PC);
+  }
+  delete_dungeon(&d);
+}
+
+static void *sim_worker(void *v)
+{
+  sim_worker_t *w = (sim_worker_t *) v;
+  uint32_t n;
+
+  while ((n = __sync_fetch_and_add(&w->s->next_game, 1)) < w->s->games) {
+    sim_play(w, n);
+  }
+
+  return NULL;
+}
+
+int sim_games(dungeon *proto, uint32_t games, uint32_t seed, uint32_t jobs,
+              const sim_checkpoint_t *cp)
+{
+  static const sim_checkpoint_t none = { 0, NULL, 0, NULL };
+  sim_checkpoint_t single;
+  pack_writer_t corpus;
+  pack_t levels;
+  std::string path;
+  int64_t level;
+  sim_t s;
+  std::vector<sim_worker_t> w;
+  uint32_t i, j, killed, outcomes[num_sim_outcomes];
+  uint64_t turns;
+  double start, elapsed;
+
+  if (!jobs) {
+    jobs = 1;
+  }
+  if (jobs > games) {
+    jobs = games ? games : 1;
+  }
+
+  io_init_headless();
+
+  s.proto = proto;
+  s.games = games;
+  s.seed = seed;
+  s.next_game = 0;
+  s.game = (sim_game_t *) calloc(games ? games : 1, sizeof (*s.game));
+  single = cp ? *cp : none;
+  s.levels = NULL;
+  s.corpus = NULL;
+  s.next_append = 0;
+  s.append_failed = 0;
+  pthread_mutex_init(&s.lock, NULL);
+
+  /* Packs work for any number of games, rather than just the one.  A *
+   * level named in a pack, as "<pack>:<n>", is an ordinary load.     */
+  if (single.load && single.load_file &&
+      pack_name(single.load_file, &path, &level) && level < 0) {
+    pack_open(&levels, path.c_str());
+    if (games > levels.count) {
+      fprintf(stderr, "%s has only %u levels for %u games.\n",
+              path.c_str(), levels.count, games);
+      exit(1);
+    }
+    s.levels = &levels;
+    single.load = 0;
+  }
+  if (single.save && single.save_file &&
+      pack_name(single.save_file, &path, &level)) {
+    if (level >= 0 || pack_writer_open(&corpus, path.c_str())) {
+      fprintf(stderr, "Can't add levels to %s.\n", single.save_file);
+      exit(1);
+    }
+    s.corpus = &corpus;
+    s.pending.resize(games);
+    single.save = 0;
+  }
+  s.cp = games == 1 ? &single : &none;
+
+  w.resize(jobs);
+
+  start = wall_time();
+  for (i = 0; i < jobs; i++) {
+    w[i].s = &s;
+    w[i].killed.assign(proto->monster_descriptions.size(), 0);
+    if (pthread_create(&w[i].thread, NULL, sim_worker, &w[i])) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+  for (i = 0; i < jobs; i++) {
+    pthread_join(w[i].thread, NULL);
+  }
+  elapsed = wall_time() - start;
+
+  if (s.levels) {
+    pack_close(s.levels);
+  }
+  if (s.corpus && (pack_writer_close(s.corpus) || s.append_failed)) {
+    fprintf(stderr, "Couldn't add levels to %s.\n", cp->save_file);
+  }
+  pthread_mutex_destroy(&s.lock);
+
+  if (games <= SIM_LIST_GAMES) {
+    printf("%10s %8s %10s %7s %6s %10s\n",
+           "seed", "turns", "game time", "outcome", "kills", "turns/s");
+    for (i = 0; i < games; i++) {
+      printf("%10llu %8u %10u %7s %6u %10.0f\n",
+             (unsigned long long) s.game[i].seed,
+             s.game[i].turns, s.game[i].time,
+             sim_outcome_name[s.game[i].outcome],
+             s.game[i].kills,
+             (s.game[i].elapsed > 0.0 ?
+              s.game[i].turns / s.game[i].elapsed : 0.0));
+    }
+  }
+
+  turns = 0;
+  outcomes[sim_won] = outcomes[sim_died] = outcomes[sim_draw] = 0;
+  for (i = 0; i < games; i++) {
+    turns += s.game[i].turns;
+    outcomes[s.game[i].outcome]++;
+  }
+
+  printf("%u games on %u threads in %.2fs: %u won (%.1f%%), %u died, "
+         "%u draws\n", games, jobs, elapsed, outcomes[sim_won],
+         games ? 100.0 * outcomes[sim_won] / games : 0.0,
+         outcomes[sim_died], outcomes[sim_draw]);
+  printf("Mean length %.1f turns; %.0f turns/s overall\n",
+         games ? (double) turns / games : 0.0,
+         elapsed > 0.0 ? turns / elapsed : 0.0);
+
+  printf("%-32s %8s %10s\n", "monster", "killed", "per game");
+  for (j = 0; j < proto->monster_descriptions.size(); j++) {
+    for (killed = i = 0; i < jobs; i++) {
+      killed += w[i].killed[j];
+    }
+    printf("%-32s %8u %10.3f\n",
+           proto->monster_descriptions[j].get_name().c_str(), killed,
+           games ? (double) killed / games : 0.0);
+  }
+
+  free(s.game);
+
+  io_reset_terminal();
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef SIM_H
+# define SIM_H
+
+# include <stdint.h>
+
+/* A game that hasn't ended after this many PC turns is called a draw. *
+ * The autopilot isn't guaranteed to ever find the boss.              */
+# define SIM_MAX_TURNS 100000
+
+/* Sweeps bigger than this only print the aggregate statistics. */
+# define SIM_LIST_GAMES 64
+
+class dungeon;
+
+/* A single headless game may start from a save file instead of its    *
+ * seed, and may checkpoint itself when it stops, which, short of the  *
+ * PC dying or winning, is after SIM_MAX_TURNS.  Resuming a checkpoint *
+ * plays on exactly as if the game had never stopped.  A NULL file is  *
+ * the default save file, as with --load and --save.                   *
+ *                                                                     *
+ * Any number of games may load from or save to a pack (see pack.h)    *
+ * instead: game n plays level n of the pack it loads, and adds the    *
+ * level it starts on to the pack it saves to, in order of seed.       */
+typedef struct sim_checkpoint {
+  uint32_t load;
+  char *load_file;
+  uint32_t save;
+  char *save_file;
+} sim_checkpoint_t;
+
+/* Plays games headless, the PC driven by pc_next_pos(), with seeds     *
+ * seed, seed + 1, ..., spread over jobs threads.  Games share nothing, *
+ * so results don't depend on the number of threads.  proto supplies    *
+ * the options and the parsed descriptions; each game gets a fresh copy *
+ * of them.  cp applies only when there is one game, unless it names   *
+ * packs.                                                               */
+int sim_games(dungeon *proto, uint32_t games, uint32_t seed, uint32_t jobs,
+              const sim_checkpoint_t *cp);
+
+#endif
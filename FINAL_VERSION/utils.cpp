@@ -3,6 +3,7 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <stdio.h>
+#include <sys/time.h>
 
 #include "utils.h"
 
@@ -40,3 +41,12 @@ int makedirectory(char *dir)
 
   return 0;
 }
+
+double wall_time(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}